@@ -0,0 +1,279 @@
+#define _POSIX_C_SOURCE 200809L
+#include "obelisk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+uint64_t
+ob_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void
+copy_field(char *dst, size_t cap, const char *src, size_t n)
+{
+    if (n >= cap) { n = cap - 1; }
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+void
+ob_init(ob_client_t *c, int fd, const char *self, uint8_t window)
+{
+    memset(c, 0, sizeof(*c));
+    c->fd     = fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    c->window = (window == 0 || window > OB_WINDOW_MAX) ? 4 : window;
+    copy_field(c->self, sizeof(c->self), self, strlen(self));
+}
+
+bool
+ob_can_queue(const ob_client_t *c)
+{
+    return c->inflight < c->window;
+}
+
+static int
+append_frame(ob_client_t *c, const char *to, const char *tag, const char *payload)
+{
+    size_t room = sizeof(c->tx) - c->txlen;
+    int    n    = snprintf(c->tx + c->txlen, room, "%s:%s%s:%s\n",
+                           to, tag, payload, c->self);
+    if (n < 0 || (size_t)n >= room)
+    { return -1; }
+
+    c->txlen += (size_t)n;
+    c->stats.tx_frames++;
+    return 0;
+}
+
+int
+ob_queue(ob_client_t *c, const char *to, const char *payload, void *user)
+{
+    if (!ob_can_queue(c))
+    { return -1; }
+
+    ob_pending_t *slot = NULL;
+    for (size_t i = 0; i < OB_WINDOW_MAX && !slot; i++)
+    {
+        if (!c->pend[i].used) { slot = &c->pend[i]; }
+    }
+    if (!slot)
+    { return -1; }
+
+    uint16_t seq = c->next_seq++;
+    char     tag[8];
+    snprintf(tag, sizeof(tag), "#%u:", seq);
+    if (append_frame(c, to, tag, payload) != 0)
+    { return -1; }
+
+    slot->used    = true;
+    slot->seq     = seq;
+    slot->sent_us = 0;          /* stamped by ob_flush() */
+    slot->user    = user;
+    c->inflight++;
+    return seq;
+}
+
+int
+ob_queue_raw(ob_client_t *c, const char *to, const char *payload)
+{
+    return append_frame(c, to, "", payload);
+}
+
+int
+ob_flush(ob_client_t *c)
+{
+    size_t off = 0;
+    while (off < c->txlen)
+    {
+        ssize_t n = write(c->fd, c->tx + off, c->txlen - off);
+        if (n < 0)
+        {
+            if (errno == EINTR) { continue; }
+            if (errno == EAGAIN)
+            {
+                struct pollfd p = { .fd = c->fd, .events = POLLOUT };
+                poll(&p, 1, 100);
+                continue;
+            }
+            return -1;
+        }
+        off += (size_t)n;
+    }
+
+    /* the frames leave now: start the clock of everything just sent */
+    uint64_t now = ob_now_us();
+    for (size_t i = 0; i < OB_WINDOW_MAX; i++)
+    {
+        if (c->pend[i].used && c->pend[i].sent_us == 0) { c->pend[i].sent_us = now; }
+    }
+    c->txlen = 0;
+    return 0;
+}
+
+/* <TO>:<PAYLOAD>:<FROM>, payload may hold ':' - split at first and last */
+static bool
+parse_line(ob_client_t *c, const char *line, ob_reply_t *out)
+{
+    const char *first = strchr(line, ':');
+    const char *last  = strrchr(line, ':');
+    if (!first || first == last || first == line || last[1] == '\0')
+    { return false; }
+
+    memset(out, 0, sizeof(*out));
+    out->rtt_us = -1;
+    copy_field(out->to, sizeof(out->to), line, (size_t)(first - line));
+    copy_field(out->from, sizeof(out->from), last + 1, strlen(last + 1));
+
+    const char *pl = first + 1;
+    size_t      pn = (size_t)(last - pl);
+    if (pn > 1 && pl[0] == '#')
+    {
+        char *end;
+        unsigned long seq = strtoul(pl + 1, &end, 10);
+        if (*end == ':' && end < last)
+        {
+            out->tagged = true;
+            out->seq    = (uint16_t)seq;
+            pn -= (size_t)(end + 1 - pl);
+            pl  = end + 1;
+        }
+    }
+    copy_field(out->payload, sizeof(out->payload), pl, pn);
+    out->is_err = strncmp(out->payload, "ERR:", 4) == 0;
+
+    if (out->tagged)
+    {
+        for (size_t i = 0; i < OB_WINDOW_MAX; i++)
+        {
+            ob_pending_t *p = &c->pend[i];
+            if (p->used && p->seq == out->seq)
+            {
+                out->matched = true;
+                out->rtt_us  = (int64_t)(ob_now_us() - p->sent_us);
+                out->user    = p->user;
+                p->used = false;
+                c->inflight--;
+                break;
+            }
+        }
+        if (!out->matched) { c->stats.rx_unmatched++; }
+    }
+    return true;
+}
+
+int
+ob_poll(ob_client_t *c, int timeout_ms, ob_reply_t *out)
+{
+    uint64_t deadline = ob_now_us() + (uint64_t)(timeout_ms < 0 ? 0 : timeout_ms) * 1000ULL;
+
+    for (;;)
+    {
+        /* one byte at a time: never read past the frame we return */
+        char    ch;
+        ssize_t n = read(c->fd, &ch, 1);
+        if (n == 1)
+        {
+            if (ch == '\r') { continue; }
+            if (ch != '\n')
+            {
+                if (c->rxlen < sizeof(c->rx) - 1) { c->rx[c->rxlen++] = ch; }
+                continue;
+            }
+
+            c->rx[c->rxlen] = '\0';
+            c->rxlen = 0;
+            if (parse_line(c, c->rx, out))
+            {
+                c->stats.rx_frames++;
+                return 1;
+            }
+            c->stats.rx_malformed++;
+            continue;
+        }
+        if (n == 0)
+        { return -1; }
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        { return -1; }
+
+        uint64_t now = ob_now_us();
+        if (now >= deadline)
+        { return 0; }
+
+        struct pollfd p = { .fd = c->fd, .events = POLLIN };
+        int r = poll(&p, 1, (int)((deadline - now + 999) / 1000));
+        if (r == 0)
+        { return 0; }
+        if (r < 0 && errno != EINTR)
+        { return -1; }
+        if (r > 0 && (p.revents & (POLLERR | POLLHUP)) && !(p.revents & POLLIN))
+        { return -1; }
+    }
+}
+
+size_t
+ob_expire(ob_client_t *c, uint64_t max_age_us,
+          void (*cb)(void *user, uint16_t seq, void *ctx), void *ctx)
+{
+    uint64_t now = ob_now_us();
+    size_t   n   = 0;
+
+    for (size_t i = 0; i < OB_WINDOW_MAX; i++)
+    {
+        ob_pending_t *p = &c->pend[i];
+        if (!p->used || p->sent_us == 0 || now - p->sent_us < max_age_us)
+        { continue; }
+
+        p->used = false;
+        c->inflight--;
+        c->stats.expired++;
+        n++;
+        if (cb) { cb(p->user, p->seq, ctx); }
+    }
+    return n;
+}
+
+int
+ob_request(ob_client_t *c, const char *to, const char *payload,
+           ob_reply_t *out, int timeout_ms)
+{
+    int seq = ob_queue(c, to, payload, NULL);
+    if (seq < 0 || ob_flush(c) != 0)
+    { return -1; }
+
+    uint64_t deadline = ob_now_us() + (uint64_t)timeout_ms * 1000ULL;
+    for (;;)
+    {
+        uint64_t now = ob_now_us();
+        if (now >= deadline)
+        { break; }
+
+        int r = ob_poll(c, (int)((deadline - now) / 1000), out);
+        if (r < 0)
+        { return -1; }
+        if (r == 1 && out->matched && out->seq == (uint16_t)seq)
+        { return 1; }
+    }
+
+    /* give the slot back so a late reply counts as unmatched */
+    for (size_t i = 0; i < OB_WINDOW_MAX; i++)
+    {
+        if (c->pend[i].used && c->pend[i].seq == (uint16_t)seq)
+        {
+            c->pend[i].used = false;
+            c->inflight--;
+            c->stats.expired++;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef OBELISK_H
+#define OBELISK_H
+
+/*
+ * obelisk - host-side client for the vertex line protocol.
+ *
+ *   <TO>:<PAYLOAD>:<FROM>\n
+ *
+ * Works over any file descriptor (serial port, pty, socket).  Requests are
+ * tagged "#<seq>" (see README, PIPELINING) so several can be in flight;
+ * replies are matched back to their request by tag, not by order.  Frames
+ * are batched in a TX buffer until ob_flush(); the descriptor is switched
+ * to non-blocking mode by ob_init().
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OB_LINE_MAX    256
+#define OB_ADDR_MAX    32
+#define OB_WINDOW_MAX  32
+
+typedef struct
+{
+    bool      used;
+    uint16_t  seq;
+    uint64_t  sent_us;
+    void     *user;
+} ob_pending_t;
+
+typedef struct
+{
+    char      to[OB_ADDR_MAX];
+    char      from[OB_ADDR_MAX];
+    char      payload[OB_LINE_MAX];   /* tag stripped                     */
+    bool      tagged;
+    uint16_t  seq;
+    bool      matched;                /* answered one of our requests     */
+    bool      is_err;                 /* payload starts with "ERR:"       */
+    int64_t   rtt_us;                 /* send to receive, -1 if unmatched */
+    void     *user;                   /* as given to ob_queue()           */
+} ob_reply_t;
+
+typedef struct
+{
+    uint64_t  tx_frames;
+    uint64_t  rx_frames;
+    uint64_t  rx_unmatched;           /* tagged, but no such request      */
+    uint64_t  rx_malformed;
+    uint64_t  expired;                /* requests given up by ob_expire() */
+} ob_stats_t;
+
+typedef struct
+{
+    int           fd;
+    char          self[OB_ADDR_MAX];
+    uint8_t       window;
+    uint8_t       inflight;
+    uint16_t      next_seq;
+    ob_pending_t  pend[OB_WINDOW_MAX];
+    char          tx[4096];
+    size_t        txlen;
+    char          rx[OB_LINE_MAX];
+    size_t        rxlen;
+    ob_stats_t    stats;
+} ob_client_t;
+
+uint64_t
+ob_now_us(void);
+
+/* window: max outstanding requests, 1..OB_WINDOW_MAX (device default 4) */
+void
+ob_init(ob_client_t *c, int fd, const char *self, uint8_t window);
+
+/* Tagged request, batched until ob_flush().  Returns the tag, or -1 if
+ * the window or the TX buffer is full. */
+int
+ob_queue(ob_client_t *c, const char *to, const char *payload, void *user);
+
+/* Untagged, untracked frame (e.g. REG:ACK, which is never answered). */
+int
+ob_queue_raw(ob_client_t *c, const char *to, const char *payload);
+
+int
+ob_flush(ob_client_t *c); /* 0 on success, -1 on write error */
+
+bool
+ob_can_queue(const ob_client_t *c);
+
+/* Waits up to timeout_ms for one complete frame.
+ * Returns 1 with *out filled, 0 on timeout, -1 on error / EOF. */
+int
+ob_poll(ob_client_t *c, int timeout_ms, ob_reply_t *out);
+
+/* Drops requests older than max_age_us, reporting each via cb. */
+size_t
+ob_expire(ob_client_t *c, uint64_t max_age_us,
+          void (*cb)(void *user, uint16_t seq, void *ctx), void *ctx);
+
+/* Blocking request/response convenience. 1 ok, 0 timeout, -1 error. */
+int
+ob_request(ob_client_t *c, const char *to, const char *payload,
+           ob_reply_t *out, int timeout_ms);
+
+#endif /* OBELISK_H */
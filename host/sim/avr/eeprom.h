@@ -0,0 +1,27 @@
+#ifndef __SIM_AVR_EEPROM_H__
+#define __SIM_AVR_EEPROM_H__
+
+/* EEMEM variables live in an ordinary section; accesses go through the
+ * helpers in vxsim.c so they can be counted / made persistent. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM
+
+void
+eeprom_read_block(void *dst, const void *src, size_t n);
+
+void
+eeprom_update_block(const void *src, void *dst, size_t n);
+
+uint8_t
+eeprom_read_byte(const uint8_t *p);
+
+void
+eeprom_update_byte(uint8_t *p, uint8_t v);
+
+int
+eeprom_is_ready(void);
+
+#endif /* __SIM_AVR_EEPROM_H__ */
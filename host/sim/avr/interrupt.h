@@ -0,0 +1,10 @@
+#ifndef __SIM_AVR_INTERRUPT_H__
+#define __SIM_AVR_INTERRUPT_H__
+
+/* Vectors become plain functions that vxsim.c calls directly. */
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#define cli() ((void)0)
+#define sei() ((void)0)
+
+#endif /* __SIM_AVR_INTERRUPT_H__ */
@@ -0,0 +1,128 @@
+#ifndef __SIM_AVR_IO_H__
+#define __SIM_AVR_IO_H__
+
+/* Host stand-in for <avr/io.h>: ATmega328P registers as plain globals,
+ * defined in vxsim.c.  Only what the firmware touches is modelled. */
+
+#include <stdint.h>
+
+#define _BV(bit) (1U << (bit))
+
+#define SIM_REG8(name)  extern volatile uint8_t  name;
+#define SIM_REG16(name) extern volatile uint16_t name;
+
+SIM_REG8(PORTB) SIM_REG8(DDRB) SIM_REG8(PINB)
+SIM_REG8(PORTC) SIM_REG8(DDRC) SIM_REG8(PINC)
+SIM_REG8(PORTD) SIM_REG8(DDRD) SIM_REG8(PIND)
+SIM_REG8(TCCR0A) SIM_REG8(TCCR0B) SIM_REG8(TCNT0) SIM_REG8(OCR0A) SIM_REG8(OCR0B)
+SIM_REG8(TIMSK0) SIM_REG8(TIFR0)
+SIM_REG8(TCCR1A) SIM_REG8(TCCR1B) SIM_REG8(TCCR1C) SIM_REG8(TIMSK1) SIM_REG8(TIFR1)
+SIM_REG16(TCNT1) SIM_REG16(OCR1A) SIM_REG16(OCR1B) SIM_REG16(ICR1)
+SIM_REG8(TCCR2A) SIM_REG8(TCCR2B) SIM_REG8(TCNT2) SIM_REG8(OCR2A) SIM_REG8(OCR2B)
+SIM_REG8(TIMSK2) SIM_REG8(TIFR2)
+SIM_REG8(UCSR0A) SIM_REG8(UCSR0B) SIM_REG8(UCSR0C) SIM_REG8(UBRR0H) SIM_REG8(UBRR0L)
+SIM_REG8(UDR0)
+SIM_REG8(ADMUX) SIM_REG8(ADCSRA) SIM_REG8(ADCSRB) SIM_REG8(DIDR0) SIM_REG16(ADC)
+SIM_REG8(MCUSR) SIM_REG8(WDTCSR)
+SIM_REG16(SP)
+
+/* Reading SREG is where the simulator lets pending "interrupts" run:
+ * the firmware reads it right before every critical section. */
+volatile uint8_t *sim_sreg(void);
+#define SREG (*sim_sreg())
+
+#define RAMSTART 0x100
+#define RAMEND   0x8FF
+#define E2END    0x3FF
+
+/* bit positions */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+
+#define WGM00 0
+#define WGM01 1
+#define COM0B1 5
+#define COM0A1 7
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define WGM02 3
+#define OCF0A 1
+#define OCF0B 2
+#define OCIE0A 1
+#define OCIE0B 2
+
+#define WGM10 0
+#define WGM11 1
+#define COM1B1 5
+#define COM1A1 7
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define TOIE1 0
+
+#define WGM20 0
+#define WGM21 1
+#define COM2B1 5
+#define COM2A1 7
+#define CS20 0
+#define CS21 1
+#define CS22 2
+
+#define MPCM0 0
+#define U2X0 1
+#define UDRE0 5
+#define TXC0 6
+#define RXC0 7
+#define TXB80 0
+#define RXB80 1
+#define UCSZ02 2
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+#define UCSZ00 1
+#define UCSZ01 2
+
+#define REFS0 6
+#define REFS1 7
+#define ADLAR 5
+#define MUX0 0
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+#define WDP0 0
+#define WDP1 1
+#define WDP2 2
+#define WDE 3
+#define WDCE 4
+#define WDP3 5
+#define WDIE 6
+
+#endif /* __SIM_AVR_IO_H__ */
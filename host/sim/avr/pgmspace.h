@@ -0,0 +1,28 @@
+#ifndef __SIM_AVR_PGMSPACE_H__
+#define __SIM_AVR_PGMSPACE_H__
+
+/* Host has one address space: flash accessors are plain reads. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P             const char *
+#define PSTR(s)           (s)
+
+#define pgm_read_byte(p)  (*(const uint8_t *)(p))
+#define pgm_read_word(p)  (*(const uint16_t *)(p))
+#define pgm_read_ptr(p)   (*(const void * const *)(p))
+
+#define strcmp_P          strcmp
+#define strncmp_P         strncmp
+#define strcpy_P          strcpy
+#define strlen_P          strlen
+#define memcpy_P          memcpy
+
+/* avr-libc prints flash strings with %S, glibc reads that as wchar_t */
+int
+snprintf_P(char *buf, size_t cap, const char *fmt, ...);
+
+#endif /* __SIM_AVR_PGMSPACE_H__ */
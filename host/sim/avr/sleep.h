@@ -0,0 +1,12 @@
+#ifndef __SIM_AVR_SLEEP_H__
+#define __SIM_AVR_SLEEP_H__
+
+/* No sleep in the simulator: an idle scheduler just spins, and reading
+ * SREG on the next scan delivers whatever became pending */
+#define SLEEP_MODE_IDLE  0
+#define set_sleep_mode(m) ((void)(m))
+#define sleep_enable()   ((void)0)
+#define sleep_disable()  ((void)0)
+#define sleep_cpu()      ((void)0)
+
+#endif /* __SIM_AVR_SLEEP_H__ */
@@ -0,0 +1,9 @@
+#ifndef __SIM_AVR_WDT_H__
+#define __SIM_AVR_WDT_H__
+
+/* No watchdog in the simulator */
+#define wdt_reset()    ((void)0)
+#define wdt_disable()  ((void)0)
+#define wdt_enable(t)  ((void)(t))
+
+#endif /* __SIM_AVR_WDT_H__ */
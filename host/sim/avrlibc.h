@@ -0,0 +1,13 @@
+#ifndef __SIM_AVRLIBC_H__
+#define __SIM_AVRLIBC_H__
+
+/* avr-libc <stdlib.h> extras missing from the host libc; force-included
+ * into every firmware object built for the simulator. */
+
+char *
+utoa(unsigned int val, char *s, int radix);
+
+char *
+ultoa(unsigned long val, char *s, int radix);
+
+#endif /* __SIM_AVRLIBC_H__ */
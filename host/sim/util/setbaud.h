@@ -0,0 +1,9 @@
+#ifndef __SIM_UTIL_SETBAUD_H__
+#define __SIM_UTIL_SETBAUD_H__
+
+#define UBRR_VALUE  ((F_CPU + 8UL * BAUD) / (16UL * BAUD) - 1UL)
+#define UBRRH_VALUE (UBRR_VALUE >> 8)
+#define UBRRL_VALUE (UBRR_VALUE & 0xFF)
+#define USE_2X      0
+
+#endif /* __SIM_UTIL_SETBAUD_H__ */
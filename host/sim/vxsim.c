@@ -0,0 +1,292 @@
+/*
+ * vxsim - the vertex firmware running on the host.
+ *
+ * The unmodified firmware sources are compiled against the register shims
+ * in host/sim and linked with this file.  Its main() becomes vertex_main().
+ * Interrupts are delivered whenever the firmware reads SREG (it does so
+ * before every critical section and on every timer_now()): elapsed real
+ * milliseconds tick TIMER0_COMPA_vect, bytes from the tty are fed to
+ * USART_RX_vect and USART_UDRE_vect is drained to the tty, both paced to
+ * BAUD so ring buffers fill the way they do on the wire.  A free-running
+ * ADC delivers ADC_vect at 125 kHz / 13 with the level in $VXSIM_ADC
+ * (0..1023, default 512) plus a little noise.  An RS-485 build gets
+ * USART_TX_vect one idle byte time after its last byte.  With VXSIM_BUS
+ * set, every TX byte goes out as "B<byte>" and every change of the DE
+ * pin (D2) as "D0"/"D1", for vxbus to run several nodes on one bus.
+ *
+ *   vxsim [tty]     attach to tty (e.g. a pty slave), stdin/stdout if none
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "avr/io.h"
+#include "avr/eeprom.h"
+#include "avr/pgmspace.h"
+
+#define SIM_SERVICE_US  100   /* min real time between interrupt passes */
+
+/* Registers */
+volatile uint8_t  PORTB, DDRB, PINB, PORTC, DDRC, PINC, PORTD, DDRD, PIND;
+volatile uint8_t  TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+volatile uint8_t  TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t  TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, TIFR2;
+volatile uint8_t  UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L, UDR0;
+volatile uint8_t  ADMUX, ADCSRA, ADCSRB, DIDR0;
+volatile uint16_t ADC;
+volatile uint8_t  MCUSR, WDTCSR;
+volatile uint16_t SP = RAMEND;
+
+void TIMER0_COMPA_vect(void);
+void USART_RX_vect(void);
+void USART_UDRE_vect(void);
+void USART_TX_vect(void) __attribute__((weak)); /* only with RS485_ENABLE */
+void ADC_vect(void) __attribute__((weak)); /* only with AMBIENT_ENABLE */
+int  vertex_main(void);
+
+static volatile uint8_t s_sreg;
+static int              s_rfd = -1, s_wfd = -1;
+static int              s_in_isr;
+static uint64_t         s_t0_us, s_last_service_us, s_ms_done;
+static double           s_wire_credit;   /* bytes the line may carry now */
+static double           s_adc_credit;    /* conversions due */
+static int              s_adc_level = 512;
+static int              s_bus;           /* VXSIM_BUS: tagged bytes + DE  */
+static int              s_de;            /* last DE level reported        */
+static int              s_tx_busy;       /* a byte went out, TXC not yet  */
+
+static uint8_t          s_rx[4096];
+static size_t           s_rx_len, s_rx_pos;
+
+static uint64_t
+now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void
+tx_put(uint8_t *buf, size_t *n, uint8_t tag, uint8_t v)
+{
+    if (s_bus)
+    { buf[(*n)++] = tag; }
+    buf[(*n)++] = v;
+}
+
+static void
+de_check(uint8_t *buf, size_t *n)
+{
+    int de = (PORTD & _BV(PD2)) != 0;
+    if (s_bus && de != s_de)
+    { tx_put(buf, n, 'D', (uint8_t)('0' + de)); }
+    s_de = de;
+}
+
+static void
+service(void)
+{
+    TIFR0 = 0; /* flags are write-1-to-clear on the chip; here ISRs never pend */
+
+    uint64_t now = now_us() - s_t0_us;
+    if (now - s_last_service_us < SIM_SERVICE_US)
+    { return; }
+
+    double dt = (double)(now - s_last_service_us) / 1e6;
+    s_last_service_us = now;
+
+    /* Timer0: one compare match per elapsed ms, TCNT0 shows the rest */
+    while (s_ms_done < now / 1000)
+    {
+        s_ms_done++;
+        TIMER0_COMPA_vect();
+    }
+    TCNT0 = (uint8_t)((now % 1000) / 4);
+
+    /* ADC in free-running mode: one conversion per 13 ADC clocks */
+    const uint8_t adc_run = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADSC);
+    if (ADC_vect && (ADCSRA & adc_run) == adc_run)
+    {
+        s_adc_credit += dt * 125000.0 / 13.0;
+        if (s_adc_credit > 256.0) { s_adc_credit = 256.0; }
+        for (; s_adc_credit >= 1.0; s_adc_credit -= 1.0)
+        {
+            int v = s_adc_level + rand() % 9 - 4;
+            ADC = (uint16_t)(v < 0 ? 0 : v > 1023 ? 1023 : v);
+            ADC_vect();
+        }
+    }
+
+    /* 8N1: 10 bits per byte; full duplex, so RX and TX each get the rate */
+    s_wire_credit += dt * (double)BAUD / 10.0;
+    if (s_wire_credit > 64.0) { s_wire_credit = 64.0; }
+    double rx_credit = s_wire_credit, tx_credit = s_wire_credit;
+    s_wire_credit -= (uint32_t)s_wire_credit;
+
+    if (s_rx_pos == s_rx_len)
+    {
+        ssize_t n = read(s_rfd, s_rx, sizeof(s_rx));
+        if (n > 0)
+        { s_rx_len = (size_t)n; s_rx_pos = 0; }
+        else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        { exit(0); } /* host hung up */
+    }
+    for (; rx_credit >= 1.0 && s_rx_pos < s_rx_len; rx_credit -= 1.0)
+    {
+        UDR0 = s_rx[s_rx_pos++];
+        if (UCSR0B & _BV(RXCIE0)) { USART_RX_vect(); }
+    }
+
+    /* the UDRE handler either loads UDR0 or, ring empty, masks itself */
+    uint8_t tx[140];
+    size_t  ntx = 0;
+    de_check(tx, &ntx);
+    for (; tx_credit >= 1.0 && ntx < 128 && (UCSR0B & _BV(UDRIE0)); tx_credit -= 1.0)
+    {
+        USART_UDRE_vect();
+        if (UCSR0B & _BV(UDRIE0))
+        {
+            tx_put(tx, &ntx, 'B', UDR0);
+            s_tx_busy = 1;
+        }
+    }
+    /* a byte time went by with nothing to send: the last stop bit is out */
+    if (s_tx_busy && tx_credit >= 1.0 && !(UCSR0B & _BV(UDRIE0)))
+    {
+        s_tx_busy = 0;
+        if (USART_TX_vect && (UCSR0B & _BV(TXCIE0)))
+        { USART_TX_vect(); }
+    }
+    de_check(tx, &ntx);
+    if (ntx && write(s_wfd, tx, ntx) < 0 && errno != EAGAIN)
+    { exit(0); }
+
+    if (!ntx && s_rx_pos == s_rx_len)
+    { usleep(SIM_SERVICE_US / 2); } /* idle: don't spin a host core */
+}
+
+volatile uint8_t *
+sim_sreg(void)
+{
+    if (!s_in_isr)
+    {
+        s_in_isr = 1;
+        service();
+        s_in_isr = 0;
+    }
+    return &s_sreg;
+}
+
+/* EEPROM: EEMEM objects are ordinary host memory */
+void
+eeprom_read_block(void *dst, const void *src, size_t n)
+{ memcpy(dst, src, n); }
+
+void
+eeprom_update_block(const void *src, void *dst, size_t n)
+{ memcpy(dst, src, n); }
+
+uint8_t
+eeprom_read_byte(const uint8_t *p)
+{ return *p; }
+
+void
+eeprom_update_byte(uint8_t *p, uint8_t v)
+{ *p = v; }
+
+int
+eeprom_is_ready(void)
+{ return 1; }
+
+/* avr-libc extras */
+int
+snprintf_P(char *buf, size_t cap, const char *fmt, ...)
+{
+    char    f[256];
+    size_t  i = 0;
+    for (; *fmt && i < sizeof(f) - 1; fmt++, i++)
+    { f[i] = (*fmt == 'S' && i && f[i - 1] == '%') ? 's' : *fmt; }
+    f[i] = '\0';
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, cap, f, ap);
+    va_end(ap);
+    return n;
+}
+
+char *
+ultoa(unsigned long val, char *s, int radix)
+{
+    char  tmp[33];
+    int   n = 0;
+    do
+    {
+        unsigned d = (unsigned)(val % (unsigned long)radix);
+        tmp[n++] = (char)(d < 10 ? '0' + d : 'a' + d - 10);
+        val /= (unsigned long)radix;
+    } while (val);
+
+    for (int i = 0; i < n; i++) { s[i] = tmp[n - 1 - i]; }
+    s[n] = '\0';
+    return s;
+}
+
+char *
+utoa(unsigned int val, char *s, int radix)
+{
+    return ultoa(val, s, radix);
+}
+
+/* mem.c is AVR-only (init-section asm, linker symbols) */
+#include "mem.h"
+
+void
+mem_sample(void)
+{}
+
+void
+mem_stats(mem_stats_t *out)
+{ memset(out, 0, sizeof(*out)); }
+
+int
+main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        s_rfd = s_wfd = open(argv[1], O_RDWR | O_NOCTTY);
+        if (s_rfd < 0) { perror(argv[1]); return 1; }
+    }
+    else
+    {
+        s_rfd = STDIN_FILENO;
+        s_wfd = STDOUT_FILENO;
+    }
+
+    struct termios tio;
+    if (tcgetattr(s_rfd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(s_rfd, TCSANOW, &tio);
+    }
+    fcntl(s_rfd, F_SETFL, fcntl(s_rfd, F_GETFL) | O_NONBLOCK);
+
+    s_bus = getenv("VXSIM_BUS") != NULL;
+
+    const char *adc = getenv("VXSIM_ADC");
+    if (adc)
+    { s_adc_level = atoi(adc); }
+
+    s_t0_us = now_us();
+    return vertex_main();
+}
@@ -0,0 +1,109 @@
+/*
+ * statecheck - GET:SINCE version arithmetic across the 16-bit wrap.
+ *
+ * Links the firmware's state.c (built for the host, as in vxsim) against
+ * stub getters, drives tens of thousands of version bumps and checks
+ * which fields state_changed_since() reports.  Exits 1 on any mismatch.
+ *
+ *   statecheck
+ */
+
+#include "state.h"
+#include "led.h"
+#include "alarm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint8_t  s_lamp;
+static uint8_t  s_bright;
+static unsigned s_fail;
+
+uint8_t
+lamp_get(void)
+{
+    return s_lamp;
+}
+
+led_state_t
+effects_get(uint8_t ch)
+{
+    led_state_t s = { 0 };
+    s.brightness = ch ? 0 : s_bright;
+    return s;
+}
+
+AlarmMode
+alarm_get_mode(void)
+{
+    return ALARM_MODE_OFF;
+}
+
+static void
+expect(const char *what, uint16_t ver, state_field_t f, bool want)
+{
+    bool got = state_changed_since(f, ver);
+    if (got != want)
+    {
+        printf("FAIL: %s: field %d since %u (now %u) -> %d, want %d\n",
+               what, (int)f, ver, state_version(), got, want);
+        s_fail++;
+    }
+}
+
+/* n versions, each one a brightness change */
+static void
+bump(unsigned long n)
+{
+    while (n--)
+    {
+        s_bright++;
+        state_sync();
+    }
+}
+
+static void
+set_lamp(uint8_t on)
+{
+    s_lamp = on;
+    state_sync();
+}
+
+int
+main(void)
+{
+    state_init();
+
+    /* a host 40000 versions behind still gets the field that kept moving */
+    uint16_t host = state_version();
+    set_lamp(1);
+    bump(40000);
+    expect("far behind", host, STATE_BRIGHT, true);
+    expect("far behind", host, STATE_LAMP, true);
+
+    /* crossing 65535 -> 1: only what changed after the host's version */
+    bump((uint16_t)(65530U - state_version()));
+    host = state_version();
+    bump(10);
+    set_lamp(0);
+    bump(3);
+    if (state_version() > host)
+    { printf("FAIL: version did not wrap (%u)\n", state_version()); s_fail++; }
+    expect("across wrap", host, STATE_BRIGHT, true);
+    expect("across wrap", host, STATE_LAMP, true);
+    expect("across wrap", host, STATE_ALARM, false);
+
+    /* a stamp left 50000 versions behind must not look new again */
+    bump(50000);
+    host = (uint16_t)(state_version() - 10);
+    expect("stale stamp", host, STATE_LAMP, false);
+    expect("stale stamp", host, STATE_BRIGHT, true);
+
+    /* up to date, from before a reboot, and never synced */
+    expect("current", state_version(), STATE_BRIGHT, false);
+    expect("ahead", (uint16_t)(state_version() + 5), STATE_LAMP, true);
+    expect("zero", 0, STATE_ALARM, true);
+
+    printf("%s: %u failures\n", s_fail ? "FAIL" : "PASS", s_fail);
+    return s_fail ? 1 : 0;
+}
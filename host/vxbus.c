@@ -0,0 +1,463 @@
+/*
+ * vxbus - RS-485 multi-drop check for several simulated vertex nodes.
+ *
+ * Starts one vxsim per node, each built with its own NODE_ADDR and
+ * NODE_SLOT and RS485_ENABLE=1 (see "make bus"), in VXSIM_BUS mode, and
+ * joins them on one half-duplex bus: a byte a node sends reaches every
+ * other node and us, the master "OB".  After answering the REGs it checks
+ *
+ *   - DE: no byte goes out with DE low, no two nodes drive the bus at
+ *     once, and DE drops within -h ms of the last byte;
+ *   - slots: ALL:GET:UPTIME and ALL:GET:ALL (the longest reply) get one
+ *     complete reply per node, in slot order, none starting before
+ *     guard + slot * NODE_SLOT ms after the request ends and none still
+ *     running when the next slot opens;
+ *   - the address filter: a command for one node is answered by that
+ *     node alone, and every node counts the others' traffic as FILTERED.
+ *
+ *   vxbus [-b baud] [-h handback_ms] [-r rounds] ADDR=vxsim ...
+ *
+ * Nodes are given in NODE_SLOT order, the first one is slot 0; slot and
+ * guard times are read from each node's GET:RX.  Exits 1 if any check
+ * failed.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NODE_MAX  8
+#define BUS_LINE  512
+#define LOG_MAX   256
+
+#define SLACK_US  5000 /* scheduling slack on our side of the pipes */
+
+typedef struct
+{
+    char     addr[16];
+    pid_t    pid;
+    int      in;           /* node RX (we write)            */
+    int      out;          /* node TX records (we read)     */
+    int      tag;          /* record tag waiting for a byte */
+    int      de;
+    uint64_t de_since;
+    uint64_t last_byte;
+    char     line[BUS_LINE];
+    size_t   nline;
+    uint64_t line_start;
+} node_t;
+
+/* one complete line seen on the bus */
+typedef struct
+{
+    int      node;
+    uint64_t start, end;
+    char     text[BUS_LINE];
+} bus_line_t;
+
+static node_t     s_node[NODE_MAX];
+static int        s_nodes;
+static bus_line_t s_log[LOG_MAX];
+static size_t     s_nlog;
+static unsigned   s_baud     = 9600;
+static unsigned   s_handback = 3;
+static unsigned   s_fail;
+static int        s_boot     = 1; /* REG jitter may collide, counted apart */
+static unsigned   s_boot_collisions;
+
+static uint64_t
+now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-b baud] [-h handback_ms] [-r rounds]\n"
+            "          ADDR=vxsim ...   (in NODE_SLOT order)\n",
+            argv0);
+    exit(2);
+}
+
+static void __attribute__((format(printf, 1, 2)))
+fail(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fputs("FAIL: ", stdout);
+    vprintf(fmt, ap);
+    putchar('\n');
+    va_end(ap);
+    s_fail++;
+}
+
+static int
+start_node(node_t *n, const char *sim)
+{
+    int to[2], from[2];
+    if (pipe(to) != 0 || pipe(from) != 0)
+    { perror("pipe"); return -1; }
+
+    n->pid = fork();
+    if (n->pid < 0)
+    { perror("fork"); return -1; }
+    if (n->pid == 0)
+    {
+        dup2(to[0], STDIN_FILENO);
+        dup2(from[1], STDOUT_FILENO);
+        close(to[0]); close(to[1]); close(from[0]); close(from[1]);
+        setenv("VXSIM_BUS", "1", 1);
+        execl(sim, sim, (char *)NULL);
+        perror(sim);
+        _exit(127);
+    }
+    close(to[0]);
+    close(from[1]);
+    n->in  = to[1];
+    n->out = from[0];
+    fcntl(n->out, F_SETFL, fcntl(n->out, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+static void
+stop_nodes(void)
+{
+    for (int i = 0; i < s_nodes; i++)
+    {
+        if (s_node[i].pid > 0)
+        {
+            kill(s_node[i].pid, SIGTERM);
+            waitpid(s_node[i].pid, NULL, 0);
+            s_node[i].pid = -1;
+        }
+    }
+}
+
+/* the wire: everyone but the sender hears the byte */
+static void
+bus_send(int from, const uint8_t *b, size_t len)
+{
+    for (int i = 0; i < s_nodes; i++)
+    {
+        if (i != from && write(s_node[i].in, b, len) != (ssize_t)len)
+        { perror("write"); }
+    }
+}
+
+static void
+de_edge(int i, int de, uint64_t t)
+{
+    node_t *n = &s_node[i];
+    if (de)
+    {
+        for (int j = 0; j < s_nodes; j++)
+        {
+            if (j == i || !s_node[j].de)
+            { continue; }
+            if (s_boot)
+            { s_boot_collisions++; }
+            else
+            { fail("%s raised DE while %s drives the bus", n->addr, s_node[j].addr); }
+        }
+        n->last_byte = 0;
+    }
+    else if (n->last_byte && t - n->last_byte > s_handback * 1000ULL + SLACK_US)
+    {
+        fail("%s dropped DE %llu us after its last byte", n->addr,
+             (unsigned long long)(t - n->last_byte));
+    }
+    n->de       = de;
+    n->de_since = t;
+}
+
+static void
+node_byte(int i, uint8_t b, uint64_t t)
+{
+    node_t *n = &s_node[i];
+    if (!n->de)
+    { fail("%s sent 0x%02x with DE low", n->addr, b); }
+    n->last_byte = t;
+    bus_send(i, &b, 1);
+
+    if (n->nline == 0)
+    { n->line_start = t; }
+    if (b == '\n')
+    {
+        if (s_nlog < LOG_MAX)
+        {
+            bus_line_t *l = &s_log[s_nlog++];
+            l->node  = i;
+            l->start = n->line_start;
+            l->end   = t;
+            snprintf(l->text, sizeof(l->text), "%.*s", (int)n->nline, n->line);
+        }
+        n->nline = 0;
+    }
+    else if (n->nline < sizeof(n->line) - 1)
+    { n->line[n->nline++] = (char)b; }
+}
+
+/* pump the bus for ms milliseconds */
+static void
+run_for(unsigned ms)
+{
+    uint64_t end = now_us() + ms * 1000ULL;
+    for (uint64_t t = now_us(); t < end; t = now_us())
+    {
+        struct pollfd pfd[NODE_MAX];
+        for (int i = 0; i < s_nodes; i++)
+        { pfd[i] = (struct pollfd){ .fd = s_node[i].out, .events = POLLIN }; }
+        int left = (int)((end - t + 999) / 1000);
+        if (poll(pfd, (nfds_t)s_nodes, left) < 0 && errno != EINTR)
+        { perror("poll"); return; }
+
+        for (int i = 0; i < s_nodes; i++)
+        {
+            uint8_t buf[256];
+            ssize_t r = read(s_node[i].out, buf, sizeof(buf));
+            if (r == 0)
+            {
+                fail("%s exited", s_node[i].addr);
+                exit(1);
+            }
+            uint64_t tr = now_us();
+            for (ssize_t k = 0; k < r; k++)
+            {
+                node_t *n = &s_node[i];
+                if (!n->tag)
+                { n->tag = buf[k]; continue; }
+                if (n->tag == 'D')
+                { de_edge(i, buf[k] == '1', tr); }
+                else
+                { node_byte(i, buf[k], tr); }
+                n->tag = 0;
+            }
+        }
+    }
+
+    /* nobody may keep the bus once it went quiet */
+    uint64_t t = now_us();
+    for (int i = 0; i < s_nodes; i++)
+    {
+        node_t *n = &s_node[i];
+        if (n->de && n->last_byte && t - n->last_byte > s_handback * 1000ULL + SLACK_US)
+        {
+            fail("%s still holds DE %llu us after its last byte", n->addr,
+                 (unsigned long long)(t - n->last_byte));
+        }
+    }
+}
+
+/* the master talks; returns when the last stop bit has left */
+static uint64_t
+master_send(const char *line)
+{
+    size_t len = strlen(line);
+    bus_send(-1, (const uint8_t *)line, len);
+    return now_us() + len * 10000000ULL / s_baud;
+}
+
+/* replies to us carrying tag, logged since mark */
+static size_t
+replies(size_t mark, const char *tag, const bus_line_t **out, size_t max)
+{
+    size_t n = 0;
+    for (size_t k = mark; k < s_nlog && n < max; k++)
+    {
+        if (strncmp(s_log[k].text, "OB:", 3) != 0 || !strstr(s_log[k].text, tag))
+        { continue; }
+        out[n++] = &s_log[k];
+    }
+    return n;
+}
+
+/* one broadcast round; done marks a complete reply (the last field) */
+static void
+check_broadcast(unsigned seq, const char *payload, const char *done,
+                unsigned guard, unsigned slot)
+{
+    char line[64], tag[16];
+    snprintf(tag, sizeof(tag), "#%u:", seq);
+    snprintf(line, sizeof(line), "ALL:%s%s:OB\n", tag, payload);
+
+    size_t   mark = s_nlog;
+    uint64_t sent = master_send(line);
+    run_for(guard + (unsigned)s_nodes * slot + 300);
+
+    const bus_line_t *r[NODE_MAX * 2];
+    size_t            n = replies(mark, tag, r, NODE_MAX * 2);
+    if (n != (size_t)s_nodes)
+    { fail("ALL #%u: %zu replies for %d nodes", seq, n, s_nodes); }
+
+    for (size_t k = 0; k < n; k++)
+    {
+        const char *addr = s_node[r[k]->node].addr;
+        int64_t     at   = (int64_t)(r[k]->start - sent) / 1000;
+        int64_t     end  = (int64_t)(r[k]->end - sent) / 1000;
+        int64_t     lo   = guard + (int64_t)r[k]->node * slot;
+        printf("  #%-2u %-10s %-6s slot %d: %4lld..%4lld ms, %3zu bytes (slot %lld..%lld)\n",
+               seq, payload, addr, r[k]->node, (long long)at, (long long)end,
+               strlen(r[k]->text) + 1, (long long)lo, (long long)(lo + slot));
+        if (r[k]->node != (int)k)
+        { fail("ALL #%u: reply %zu came from slot %d", seq, k, r[k]->node); }
+        if (!strstr(r[k]->text, done))
+        { fail("ALL #%u: %s reply is incomplete", seq, addr); }
+        if (at < lo - SLACK_US / 1000)
+        { fail("ALL #%u: %s answered %lld ms early", seq, addr, (long long)(lo - at)); }
+        if (end > lo + slot)
+        { fail("ALL #%u: %s ran %lld ms into the next slot", seq, addr, (long long)(end - lo - slot)); }
+    }
+}
+
+static void
+check_unicast(unsigned seq, int target)
+{
+    char line[64], tag[16];
+    snprintf(tag, sizeof(tag), "#%u:", seq);
+    snprintf(line, sizeof(line), "%.15s:%sGET:UPTIME:OB\n", s_node[target].addr, tag);
+
+    size_t mark = s_nlog;
+    master_send(line);
+    run_for(300);
+
+    const bus_line_t *r[NODE_MAX];
+    size_t            n = replies(mark, tag, r, NODE_MAX);
+    if (n != 1 || r[0]->node != target)
+    {
+        fail("%s #%u: %zu replies%s%s", s_node[target].addr, seq, n,
+             n ? ", first from " : "", n ? s_node[r[0]->node].addr : "");
+    }
+}
+
+/* GET:RX of one node: FILTERED, and its slot and guard times */
+static bool
+node_rx(unsigned seq, int target, unsigned *filtered, unsigned *slot_no,
+        unsigned *slot_ms, unsigned *guard_ms)
+{
+    char line[64], tag[16];
+    snprintf(tag, sizeof(tag), "#%u:", seq);
+    snprintf(line, sizeof(line), "%.15s:%sGET:RX:OB\n", s_node[target].addr, tag);
+
+    size_t mark = s_nlog;
+    master_send(line);
+    run_for(300);
+
+    for (size_t k = mark; k < s_nlog; k++)
+    {
+        const char *t = s_log[k].text;
+        if (s_log[k].node != target || !strstr(t, tag))
+        { continue; }
+        if (sscanf(strstr(t, "OK:RX:") ? strstr(t, "OK:RX:") : "",
+                   "OK:RX:FILTERED=%u,OVF=%*u,SLOT=%u,SLOT_MS=%u,GUARD_MS=%u",
+                   filtered, slot_no, slot_ms, guard_ms) == 4)
+        { return true; }
+    }
+    fail("%s: no GET:RX reply with slot times (RS485_ENABLE=1?)", s_node[target].addr);
+    return false;
+}
+
+static void
+check_filtered(unsigned seq, int target, unsigned want)
+{
+    unsigned got, slot_no, slot_ms, guard_ms;
+    if (!node_rx(seq, target, &got, &slot_no, &slot_ms, &guard_ms))
+    { return; }
+    printf("  %-6s FILTERED=%u\n", s_node[target].addr, got);
+    if (got < want)
+    { fail("%s filtered %u lines, expected at least %u", s_node[target].addr, got, want); }
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned guard = 0, slot = 0, rounds = 3;
+    int      opt;
+
+    while ((opt = getopt(argc, argv, "b:h:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': s_baud     = (unsigned)atoi(optarg); break;
+            case 'h': s_handback = (unsigned)atoi(optarg); break;
+            case 'r': rounds     = (unsigned)atoi(optarg); break;
+            default:  usage(argv[0]);
+        }
+    }
+    if (optind >= argc || argc - optind > NODE_MAX || !s_baud)
+    { usage(argv[0]); }
+
+    signal(SIGPIPE, SIG_IGN);
+    atexit(stop_nodes);
+    for (int a = optind; a < argc; a++)
+    {
+        node_t     *n  = &s_node[s_nodes++];
+        const char *eq = strchr(argv[a], '=');
+        if (!eq || eq == argv[a])
+        { usage(argv[0]); }
+        snprintf(n->addr, sizeof(n->addr), "%.*s", (int)(eq - argv[a]), argv[a]);
+        if (start_node(n, eq + 1) != 0)
+        { return 1; }
+    }
+
+    /* boot: every node broadcasts its REG, we acknowledge each one */
+    run_for(1500);
+    for (int i = 0; i < s_nodes; i++)
+    {
+        char line[64];
+        snprintf(line, sizeof(line), "%.15s:REG:ACK:OB\n", s_node[i].addr);
+        master_send(line);
+        run_for(100);
+    }
+    run_for(300);
+    printf("boot: %zu lines, %u REG collisions\n", s_nlog, s_boot_collisions);
+    s_boot = 0;
+
+    /* every node must agree on the timing and sit in its own slot */
+    unsigned seq = 1;
+    for (int i = 0; i < s_nodes; i++)
+    {
+        unsigned f, no, ms, g;
+        if (!node_rx(seq++, i, &f, &no, &ms, &g))
+        { return 1; }
+        if (no != (unsigned)i)
+        { fail("%s is built for slot %u, listed as %d", s_node[i].addr, no, i); }
+        if (i && (ms != slot || g != guard))
+        { fail("%s: slot %u ms, guard %u ms, others %u/%u", s_node[i].addr, ms, g, slot, guard); }
+        slot  = ms;
+        guard = g;
+    }
+
+    printf("ALL broadcast, guard %u ms, slot %u ms:\n", guard, slot);
+    for (unsigned r = 0; r < rounds; r++)
+    {
+        check_broadcast(seq++, "GET:UPTIME", "OK:UPTIME:", guard, slot);
+        check_broadcast(seq++, "GET:ALL", ",BAUD=", guard, slot);
+    }
+
+    printf("address filter:\n");
+    for (int i = 0; i < s_nodes; i++)
+    { check_unicast(seq++, i); }
+    /* each node has at least seen the unicasts to all the others */
+    for (int i = 0; i < s_nodes; i++)
+    { check_filtered(seq++, i, (unsigned)s_nodes - 1); }
+
+    printf("%s: %d nodes, %zu bus lines, %u failures\n",
+           s_fail ? "FAIL" : "PASS", s_nodes, s_nlog, s_fail);
+    return s_fail ? 1 : 0;
+}
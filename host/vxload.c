@@ -0,0 +1,328 @@
+/*
+ * vxload - load generator for vertex nodes.
+ *
+ * Drives a node with a weighted command mix at a fixed rate, keeping up to
+ * <window> tagged commands in flight, then reports latency percentiles and
+ * loss.  Without -d it starts the firmware simulator (vxsim) on a fresh pty.
+ *
+ *   vxload [-d tty [-b baud]] [-s vxsim] [-a addr] [-n count] [-r rate]
+ *          [-w window] [-t timeout_ms] [-m "PAYLOAD=weight,..."]
+ *
+ * In a mix payload, "%d" is replaced by a random 0..255.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+#include "obelisk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define MIX_MAX 16
+
+#define DEFAULT_MIX "GET:LED:BRIGHT=30,GET:ALL=20,SET:LED:BRIGHT:%d=20," \
+                    "TOGGLE:LAMP=10,GET:UPTIME=10,PING:PING=10"
+
+typedef struct
+{
+    char     payload[64];
+    unsigned weight;
+} mix_entry_t;
+
+typedef struct
+{
+    uint64_t  ok, err, lost;
+    uint32_t *rtt;
+    size_t    nrtt;
+} result_t;
+
+static pid_t s_child = -1;
+
+static void
+usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-d tty [-b baud]] [-s vxsim] [-a addr] [-n count]\n"
+            "          [-r rate] [-w window] [-t timeout_ms] [-m mix]\n"
+            "  mix: \"PAYLOAD=weight,...\", %%d -> random 0..255\n"
+            "  default mix: %s\n", argv0, DEFAULT_MIX);
+    exit(2);
+}
+
+static size_t
+parse_mix(const char *spec, mix_entry_t *mix, unsigned *total)
+{
+    char   buf[512];
+    size_t n = 0;
+    snprintf(buf, sizeof(buf), "%s", spec);
+    *total = 0;
+
+    for (char *save = NULL, *tok = strtok_r(buf, ",", &save);
+         tok && n < MIX_MAX; tok = strtok_r(NULL, ",", &save))
+    {
+        char *eq = strrchr(tok, '=');
+        mix[n].weight = eq ? (unsigned)atoi(eq + 1) : 1;
+        if (eq) { *eq = '\0'; }
+        snprintf(mix[n].payload, sizeof(mix[n].payload), "%s", tok);
+        *total += mix[n].weight;
+        n++;
+    }
+    return n;
+}
+
+static const char *
+pick(const mix_entry_t *mix, size_t n, unsigned total, char *out, size_t cap)
+{
+    unsigned r = total ? (unsigned)rand() % total : 0;
+    size_t   i = 0;
+    while (i + 1 < n && r >= mix[i].weight)
+    {
+        r -= mix[i].weight;
+        i++;
+    }
+
+    const char *pct = strstr(mix[i].payload, "%d");
+    if (!pct)
+    { return mix[i].payload; }
+
+    snprintf(out, cap, "%.*s%d%s", (int)(pct - mix[i].payload), mix[i].payload,
+             rand() % 256, pct + 2);
+    return out;
+}
+
+static speed_t
+baud_const(long baud)
+{
+    switch (baud)
+    {
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        default:     return B0;
+    }
+}
+
+static int
+open_device(const char *path, long baud)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    { perror(path); return -1; }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        if (baud_const(baud) != B0)
+        {
+            cfsetispeed(&tio, baud_const(baud));
+            cfsetospeed(&tio, baud_const(baud));
+        }
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static int
+open_sim(const char *sim)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    { perror("pty"); return -1; }
+
+    const char *slave_path = ptsname(master);
+    int slave = open(slave_path, O_RDWR | O_NOCTTY);
+    if (slave < 0)
+    { perror(slave_path); return -1; }
+
+    /* raw before the child exists, so nothing is ever echoed or cooked */
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    s_child = fork();
+    if (s_child < 0)
+    { perror("fork"); return -1; }
+    if (s_child == 0)
+    {
+        close(master);
+        execl(sim, sim, slave_path, (char *)NULL);
+        perror(sim);
+        _exit(127);
+    }
+    close(slave);
+    return master;
+}
+
+static void
+stop_sim(void)
+{
+    if (s_child > 0)
+    {
+        kill(s_child, SIGTERM);
+        waitpid(s_child, NULL, 0);
+        s_child = -1;
+    }
+}
+
+static void
+on_expired(void *user, uint16_t seq, void *ctx)
+{
+    (void)user; (void)seq;
+    ((result_t *)ctx)->lost++;
+}
+
+static void
+handle_frame(ob_client_t *c, const ob_reply_t *r, result_t *res)
+{
+    if (r->matched)
+    {
+        if (r->is_err) { res->err++; }
+        else           { res->ok++; }
+        res->rtt[res->nrtt++] = (uint32_t)r->rtt_us;
+        return;
+    }
+
+    /* we are the obelisk: acknowledge registrations */
+    if (!r->tagged && strncmp(r->payload, "REG:", 4) == 0)
+    {
+        ob_queue_raw(c, r->from, "REG:ACK");
+        ob_flush(c);
+    }
+}
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+pct_ms(const uint32_t *v, size_t n, double p)
+{
+    if (!n) { return 0.0; }
+    size_t i = (size_t)(p / 100.0 * (double)(n - 1) + 0.5);
+    return (double)v[i] / 1000.0;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *dev = NULL, *sim = NULL, *addr = "VERTEX", *mixspec = DEFAULT_MIX;
+    long        baud = 9600, count = 1000, window = 4, timeout_ms = 1000;
+    double      rate = 20.0;
+    char        simpath[4096];
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:b:s:a:n:r:w:t:m:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd': dev        = optarg;       break;
+            case 'b': baud       = atol(optarg); break;
+            case 's': sim        = optarg;       break;
+            case 'a': addr       = optarg;       break;
+            case 'n': count      = atol(optarg); break;
+            case 'r': rate       = atof(optarg); break;
+            case 'w': window     = atol(optarg); break;
+            case 't': timeout_ms = atol(optarg); break;
+            case 'm': mixspec    = optarg;       break;
+            default:  usage(argv[0]);
+        }
+    }
+    if (count <= 0 || rate <= 0.0 || window < 1 || window > OB_WINDOW_MAX)
+    { usage(argv[0]); }
+
+    if (!sim)
+    {
+        char self[4096];
+        snprintf(self, sizeof(self), "%s", argv[0]);
+        snprintf(simpath, sizeof(simpath), "%s/vxsim", dirname(self));
+        sim = simpath;
+    }
+
+    mix_entry_t mix[MIX_MAX];
+    unsigned    total;
+    size_t      nmix = parse_mix(mixspec, mix, &total);
+    if (!nmix || !total)
+    { usage(argv[0]); }
+
+    int fd = dev ? open_device(dev, baud) : open_sim(sim);
+    if (fd < 0)
+    { return 1; }
+    atexit(stop_sim);
+    srand((unsigned)ob_now_us());
+
+    ob_client_t c;
+    ob_init(&c, fd, "VXLOAD", (uint8_t)window);
+
+    result_t res = { .rtt = calloc((size_t)count, sizeof(uint32_t)) };
+    if (!res.rtt)
+    { perror("calloc"); return 1; }
+
+    /* let the node boot and register; answer its REG */
+    ob_reply_t r;
+    uint64_t   settle = ob_now_us() + 1500000ULL;
+    while (ob_now_us() < settle && ob_poll(&c, 50, &r) >= 0)
+    { handle_frame(&c, &r, &res); }
+
+    uint64_t period = (uint64_t)(1e6 / rate);
+    uint64_t start  = ob_now_us();
+    uint64_t due    = start;
+    long     sent   = 0;
+
+    while (sent < count || c.inflight)
+    {
+        uint64_t now = ob_now_us();
+        while (sent < count && now >= due && ob_can_queue(&c))
+        {
+            char buf[96];
+            ob_queue(&c, addr, pick(mix, nmix, total, buf, sizeof(buf)), NULL);
+            sent++;
+            due += period;
+        }
+        if (c.txlen && ob_flush(&c) != 0)
+        { fprintf(stderr, "write failed\n"); break; }
+
+        int wait_ms = 10;
+        if (sent < count && due > now && (due - now) / 1000 < 10)
+        { wait_ms = (int)((due - now) / 1000); }
+
+        int pr = ob_poll(&c, wait_ms, &r);
+        if (pr < 0)
+        { fprintf(stderr, "link closed\n"); break; }
+        if (pr == 1)
+        { handle_frame(&c, &r, &res); }
+
+        ob_expire(&c, (uint64_t)timeout_ms * 1000ULL, on_expired, &res);
+    }
+
+    double elapsed = (double)(ob_now_us() - start) / 1e6;
+    qsort(res.rtt, res.nrtt, sizeof(uint32_t), cmp_u32);
+
+    printf("sent %ld  ok %llu  err %llu  lost %llu  unmatched %llu  malformed %llu\n",
+           sent, (unsigned long long)res.ok, (unsigned long long)res.err,
+           (unsigned long long)res.lost, (unsigned long long)c.stats.rx_unmatched,
+           (unsigned long long)c.stats.rx_malformed);
+    printf("offered %.1f cmd/s  achieved %.1f cmd/s  window %ld  elapsed %.2f s\n",
+           rate, (double)res.nrtt / elapsed, window, elapsed);
+    printf("latency ms  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+           pct_ms(res.rtt, res.nrtt, 50.0), pct_ms(res.rtt, res.nrtt, 90.0),
+           pct_ms(res.rtt, res.nrtt, 99.0), pct_ms(res.rtt, res.nrtt, 99.9),
+           pct_ms(res.rtt, res.nrtt, 100.0));
+
+    free(res.rtt);
+    return res.lost ? 1 : 0;
+}
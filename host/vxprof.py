@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""
+vxprof - turn a vertex PC-sampling histogram into per-function figures.
+
+Builds with PROF_ENABLE=1 collect samples after ON:PROF; GET:PROF pages
+the histogram out.  With -d this script runs the whole session on a tty,
+otherwise it reads the OK:PROF reply lines from stdin (e.g. captured from
+a terminal).  Bucket ranges are mapped onto the function symbols of the
+ELF image; a bucket spanning several functions is shared by byte overlap.
+
+  vxprof.py [-e bin/vertex.elf] [-d tty [-b baud] [-a addr] [-t secs]
+            [--base WORDADDR] [--shift N]]
+
+$NM selects the nm binary (default avr-nm).
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import termios
+import time
+
+
+def read_symbols(elf):
+    nm = os.environ.get("NM", "avr-nm")
+    out = subprocess.run([nm, "-n", "-S", "--defined-only", elf],
+                         check=True, capture_output=True, text=True).stdout
+    syms = []
+    for line in out.splitlines():
+        f = line.split()
+        if len(f) == 4 and f[2] in "tTwW":
+            addr, size = int(f[0], 16), int(f[1], 16)
+            if size:
+                syms.append((addr, addr + size, f[3]))
+    return syms
+
+
+def parse_replies(lines):
+    """Collect (info, {bucket: count}) from OK:PROF:<next>/<n>:<hdr>[:<i>=<c>,...]"""
+    info, hist = None, {}
+    for line in lines:
+        at = line.find("OK:PROF:")
+        if at < 0:
+            continue
+        f = line[at:].strip().split(":")
+        hdr = [int(x) for x in f[3].split(",")]
+        info = dict(zip(("samples", "out", "base", "shift", "run"), hdr))
+        if len(f) > 4 and "=" in f[4]:
+            for kv in f[4].split(","):
+                i, c = kv.split("=")
+                hist[int(i)] = int(c)
+    return info, hist
+
+
+def open_tty(path, baud):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    a = termios.tcgetattr(fd)
+    a[0] = a[1] = a[3] = 0
+    a[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+    speed = getattr(termios, "B%d" % baud)
+    a[4] = a[5] = speed
+    a[6][termios.VMIN], a[6][termios.VTIME] = 0, 10
+    termios.tcsetattr(fd, termios.TCSANOW, a)
+    return os.fdopen(fd, "r+b", buffering=0)
+
+
+def request(tty, addr, payload):
+    tty.write(("%s:%s:PROF\n" % (addr, payload)).encode())
+    deadline = time.time() + 2
+    buf = b""
+    while time.time() < deadline:
+        buf += tty.read(64) or b""
+        while b"\n" in buf:
+            line, buf = buf.split(b"\n", 1)
+            line = line.decode(errors="replace")
+            if line.startswith("PROF:") and (":OK:" in line or ":ERR:" in line):
+                return line
+    sys.exit("vxprof: no reply to %s" % payload)
+
+
+def session(args):
+    tty = open_tty(args.d, args.b)
+    request(tty, args.a, "ON:PROF:%d:%d" % (args.base, args.shift))
+    time.sleep(args.t)
+    request(tty, args.a, "OFF:PROF")
+    lines, nxt = [], 0
+    while True:
+        line = request(tty, args.a, "GET:PROF:%d" % nxt)
+        lines.append(line)
+        f = line[line.find("OK:PROF:"):].split(":")
+        nxt, total = (int(x) for x in f[2].split("/"))
+        if nxt >= total:
+            return lines
+
+
+def main():
+    ap = argparse.ArgumentParser(description="vertex PC-sampling report")
+    ap.add_argument("-e", default="bin/vertex.elf", help="firmware image")
+    ap.add_argument("-d", help="node tty; without it replies come from stdin")
+    ap.add_argument("-b", type=int, default=9600, help="baud rate")
+    ap.add_argument("-a", default="VERTEX", help="node address")
+    ap.add_argument("-t", type=float, default=10, help="seconds to sample")
+    ap.add_argument("--base", type=lambda s: int(s, 0), default=0,
+                    help="window base, word address (0x.. for hex)")
+    ap.add_argument("--shift", type=int, default=8, help="log2 words per bucket")
+    args = ap.parse_args()
+
+    info, hist = parse_replies(session(args) if args.d else sys.stdin)
+    if info is None:
+        sys.exit("vxprof: no OK:PROF replies")
+
+    syms   = read_symbols(args.e)
+    funcs  = {}
+    width  = 2 << info["shift"]                 # bytes per bucket
+    for i, c in hist.items():
+        lo = (info["base"] << 1) + i * width
+        hi = lo + width
+        spans = [(min(hi, e) - max(lo, s), n) for s, e, n in syms if s < hi and e > lo]
+        known = sum(w for w, _ in spans)
+        if not known:
+            funcs["?%05x" % lo] = funcs.get("?%05x" % lo, 0) + c
+            continue
+        for w, n in spans:
+            funcs[n] = funcs.get(n, 0) + c * w / known
+
+    n = info["samples"] or 1
+    print("%u samples, %u outside the window, %u bytes per bucket"
+          % (info["samples"], info["out"], width))
+    for name, c in sorted(funcs.items(), key=lambda kv: -kv[1]):
+        print("%6.1f%%  %8.1f  %s" % (100.0 * c / n, c, name))
+
+
+if __name__ == "__main__":
+    main()
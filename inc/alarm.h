@@ -1,6 +1,9 @@
 #ifndef __ALARM_H__
 #define __ALARM_H__
 
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef enum
 {
     ALARM_MODE_OFF   = 0,
@@ -8,11 +11,21 @@ typedef enum
     ALARM_MODE_BLINK = 2
 } AlarmMode;
 
+/* Up to ALARM_PATTERNS buzzer patterns run at once, one per priority;
+ * the highest active priority drives the buzzer while the others keep
+ * time underneath.  All of them step on the effects frame
+ * (EFFECTS_FRAME_MS), so beeps stay in step with LED blinking.
+ * Priority 0 belongs to the stored AlarmMode. */
+#define ALARM_PRIO_MODE 0
+
 typedef struct
 {
-    AlarmMode mode;
-    bool      blink;
-} Alarm;
+    uint8_t  prio;
+    uint16_t period_ms; /* 0 = solid */
+    uint8_t  duty;      /* % of the period sounding */
+    uint8_t  repeat;    /* periods left, 0 = endless */
+    uint32_t left_ms;   /* 0 = endless */
+} AlarmPattern;
 
 void
 alarm_init(void);
@@ -20,7 +33,27 @@ alarm_init(void);
 void
 alarm_set_mode(AlarmMode mode);
 
+AlarmMode
+alarm_get_mode(void);
+
+/* (re)start the pattern at p->prio; false if a bad argument or every
+   slot holds a higher priority */
+bool
+alarm_start(const AlarmPattern *p);
+
+void
+alarm_stop(uint8_t prio);
+
+void
+alarm_stop_all(void); /* patterns and mode */
+
+bool
+alarm_pattern(uint8_t i, AlarmPattern *out); /* i-th active, highest first */
+
+bool
+alarm_sounding(void);
+
 void
-alarm_loop(void);
+alarm_frame(void); /* effects frame hook */
 
 #endif /* __ALARM_H__ */
@@ -0,0 +1,23 @@
+#ifndef __AMBIENT_H__
+#define __AMBIENT_H__
+
+#include <stdint.h>
+
+/* Ambient light level from a free-running, interrupt-driven ADC.
+ * Oversampling and smoothing happen in the ADC interrupt; readers only
+ * copy the filtered value.
+ */
+
+void
+ambient_init(void);
+
+uint16_t
+ambient_raw(void); /* filtered reading, 12 bits (0..4095) */
+
+uint8_t
+ambient_level(void); /* the same scaled to 0..255 */
+
+uint8_t
+ambient_brightness(uint8_t current); /* AUTO target, current if within hysteresis */
+
+#endif /* __AMBIENT_H__ */
@@ -0,0 +1,27 @@
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Boot phase timestamps, in us since timer_init (Timer0 start).  Time
+ * from reset to main() (bootloader, .init sections) is not visible. */
+
+typedef enum
+{
+    BOOT_HW    = 0,  /* pins, tick and UART up, interrupts on     */
+    BOOT_NV    = 1,  /* saved state loaded and applied to outputs */
+    BOOT_SCHED = 2,  /* scheduler running: commands are accepted  */
+    BOOT_CMD   = 3,  /* first command addressed to us handled     */
+    BOOT_DEFER = 4,  /* deferred init done                        */
+    BOOT_REG   = 5,  /* REG:ACK received                          */
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+void
+boot_mark(boot_phase_t p); /* only the first mark of a phase counts */
+
+bool
+boot_at(boot_phase_t p, uint32_t *us); /* false if not reached yet */
+
+#endif /* __BOOT_H__ */
@@ -0,0 +1,62 @@
+#ifndef __CMDQ_H__
+#define __CMDQ_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Bounded command queue between RX framing and handle_cmd().
+ * Lines are framed straight into one RX_LINE_MAX byte pool, so the
+ * queue costs no more line memory than the old single line buffer.
+ * Admission charges the sender's token bucket (per FROM address) and
+ * rejects the line when it is empty (throttled).  Actuation verbs
+ * (ON/OFF/TOGGLE/SET/SAVE/LOAD/REG) are served before queries, except
+ * behind an older query from the same sender, and may push out the
+ * newest queued query when the queue is full (shed).  Every rejected
+ * line is passed to the reject hook before it is dropped.
+ */
+
+typedef enum
+{
+    CMDQ_MORE      = 0,  /* byte stored, line not complete   */
+    CMDQ_QUEUED    = 1,
+    CMDQ_FOREIGN   = 2,  /* TO is neither us nor ALL          */
+    CMDQ_THROTTLED = 3,
+    CMDQ_SHED      = 4,  /* no entry left, even after evicting */
+    CMDQ_OVERFLOW  = 5   /* line longer than the whole pool   */
+} cmdq_res_t;
+
+typedef struct
+{
+    uint8_t  len;        /* queued commands now */
+    uint8_t  peak;
+    uint16_t shed;       /* dropped or evicted for lack of room */
+    uint16_t throttled;  /* dropped by a token bucket */
+} cmdq_stats_t;
+
+typedef void (*cmdq_reject_fn)(char *line, cmdq_res_t why); /* may edit line */
+
+void
+cmdq_init(cmdq_reject_fn fn);
+
+bool
+cmdq_room(void); /* false: leave RX bytes waiting */
+
+cmdq_res_t
+cmdq_feed(uint8_t b); /* frame one RX byte, only after cmdq_room() */
+
+bool
+cmdq_next(char **line); /* most urgent line, NUL-terminated, editable */
+
+void
+cmdq_done(void); /* release the line from cmdq_next() */
+
+uint16_t
+cmdq_age_ms(void); /* how long the line from cmdq_next() was queued */
+
+uint8_t
+cmdq_len(void);
+
+void
+cmdq_stats(cmdq_stats_t *out);
+
+#endif /* __CMDQ_H__ */
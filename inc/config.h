@@ -15,15 +15,225 @@
 #define FW_VERSION "2.1.1"
 #endif
 
+/* Bus address: TO field we answer to (besides "ALL") and our FROM field */
+#ifndef NODE_ADDR
+#define NODE_ADDR "VERTEX"
+#endif
+
+/* Feature profile, picked with make PROFILE=FULL|LAMP|RELAY (default
+ * FULL).  A profile only supplies defaults; every FEAT_* and buffer size
+ * can still be overridden with -D.  Disabled features drop their
+ * commands, buffers and modules from the image entirely.
+ *
+ *   FEAT_LED     PWM channels, effects, LED commands (+ WS2812, ambient)
+ *   FEAT_ALARM   buzzer / alarm engine, BUZZ commands
+ *   FEAT_STATE   versioned state, GET:ALL and GET:SINCE
+ *   FEAT_CFG     GET:CFG / SET:CFG blob transfer
+ *   FEAT_DIAG    GET:MEM, GET:RX, GET:LOOP, GET:LAT
+ *   FEAT_TRACE   flight recorder, GET:TRACE
+ *   FEAT_PRESET  PRESET_COUNT stored scenes, SAVE/LOAD:PRESET
+ *   FEAT_HEAP    heap-copying packet parser (pulls in malloc); without it
+ *                the line is split in place
+ */
+#if defined(PROFILE_RELAY)
+#   define PROFILE_NAME "RELAY"
+#   ifndef FEAT_LED
+#   define FEAT_LED     0
+#   endif
+#   ifndef FEAT_ALARM
+#   define FEAT_ALARM   0
+#   endif
+#   ifndef FEAT_STATE
+#   define FEAT_STATE   0
+#   endif
+#   ifndef FEAT_CFG
+#   define FEAT_CFG     0
+#   endif
+#   ifndef FEAT_DIAG
+#   define FEAT_DIAG    0
+#   endif
+#   ifndef FEAT_TRACE
+#   define FEAT_TRACE   0
+#   endif
+#   ifndef FEAT_HEAP
+#   define FEAT_HEAP    0
+#   endif
+#   ifndef FEAT_PRESET
+#   define FEAT_PRESET  0
+#   endif
+    /* commands are short and replies tiny: the line buffer and TX ring
+       shrink, RX keeps the full 256 bytes its 8-bit indices allow */
+#   ifndef RX_LINE_MAX
+#   define RX_LINE_MAX  64
+#   endif
+#   ifndef TX_BUF_SZ
+#   define TX_BUF_SZ    64
+#   endif
+#   ifndef CMDQ_DEPTH
+#   define CMDQ_DEPTH   4
+#   endif
+#elif defined(PROFILE_LAMP)
+#   define PROFILE_NAME "LAMP"
+#   ifndef FEAT_DIAG
+#   define FEAT_DIAG    0
+#   endif
+#   ifndef FEAT_TRACE
+#   define FEAT_TRACE   0
+#   endif
+#   ifndef FEAT_HEAP
+#   define FEAT_HEAP    0
+#   endif
+#else
+#   define PROFILE_NAME "FULL"
+#endif
+
+#ifndef FEAT_LED
+#define FEAT_LED     1
+#endif
+#ifndef FEAT_ALARM
+#define FEAT_ALARM   1
+#endif
+#ifndef FEAT_STATE
+#define FEAT_STATE   1
+#endif
+#ifndef FEAT_CFG
+#define FEAT_CFG     1
+#endif
+#ifndef FEAT_DIAG
+#define FEAT_DIAG    1
+#endif
+#ifndef FEAT_TRACE
+#define FEAT_TRACE   1
+#endif
+#ifndef FEAT_HEAP
+#define FEAT_HEAP    1
+#endif
+#ifndef FEAT_PRESET
+#define FEAT_PRESET  1
+#endif
+
+/* Sampling profiler (opt-in): Timer0 compare B, half-way through every
+ * 1 ms tick, records the interrupted program counter; the tick ISR bins
+ * it into PROF_BUCKETS counters of 2^shift words each (64 x 256 words
+ * cover the whole 32 KB flash by default).  Interrupt handlers cannot
+ * be sampled, they never nest. */
+#ifndef PROF_ENABLE
+#define PROF_ENABLE  0
+#endif
+#define PROF_BUCKETS 64
+
+/* Alarm engine: command patterns that can be active at once, one per
+ * priority, on top of the stored alarm mode.  7 bytes each. */
+#define ALARM_PATTERNS 4
+
+/* Presets: stored next to the live state, one EEPROM record each */
+#ifndef PRESET_COUNT
+#define PRESET_COUNT 4
+#endif
+
 /* Pin mapping (Arduino Nano):
- * D9  -> PB1 (OC1A)  LED strip via MOSFET
+ * D9  -> PB1 (OC1A)  LED strip via MOSFET (channel 0)
+ * D10 -> PB2 (OC1B)  LED channel 1  \
+ * D11 -> PB3 (OC2A)  LED channel 2   } only with LED_CHANNELS > n
+ * D3  -> PD3 (OC2B)  LED channel 3  /
+ * D8  -> PB0         WS2812 data, WS2812_ENABLE only
+ * A0  -> PC0 (ADC0)  Ambient light sensor (LDR divider), AMBIENT_ENABLE only
  * D6  -> PD6         Active buzzer (digital)
  * D4  -> PD4         Relay (desk lamp)
+ * D2  -> PD2         RS-485 transceiver DE (+ /RE), RS485_ENABLE only
  */
 #define LED_PORT       PORTB
 #define LED_DDR        DDRB
 #define LED_PIN_BM     _BV(PB1)     /* OC1A */
 
+/* Hardware PWM channels, 1..4.  Timer1 (channels 0-1) runs fast PWM with
+ * TOP = ICR1 at PWM_BITS, prescaler 1: 10 bits -> 15.6 kHz, 12 -> 3.9 kHz,
+ * 16 -> 244 Hz at 16 MHz.  Timer2 (channels 2-3) stays 8-bit at 7.8 kHz.
+ * Timer0 is the 1 ms system tick (CTC with OCR0A as TOP), so OC0A/OC0B
+ * cannot be used for PWM. */
+#ifndef LED_CHANNELS
+#define LED_CHANNELS   1
+#endif
+#ifndef PWM_BITS
+#define PWM_BITS       10
+#endif
+
+/* Levels 0..255 go through a 16-bit CIE 1931 lightness table in flash.
+ * PWM_DITHER spreads the table bits below PWM_BITS over successive PWM
+ * periods (first-order sigma-delta in the Timer1 overflow ISR) so the
+ * low end gets 16-bit resolution on average.  From PWM_DITHER_MAX
+ * counts up one count is under 1.6 % of the light, too fine to see, so
+ * the duty is rounded instead; the ISR (one per PWM period, 15.6 kHz at
+ * 10 bits) runs only while a channel 0-1 sits below that, i.e. up to
+ * level 76 at 10 bits. */
+#ifndef PWM_DITHER
+#define PWM_DITHER     1
+#endif
+#ifndef PWM_DITHER_MAX
+#define PWM_DITHER_MAX 64
+#endif
+
+/* Effects frame: BLINK/FADE steps and the alarm pattern cadence */
+#define EFFECTS_FRAME_MS 100
+
+#define LED1_DDR       DDRB
+#define LED1_PIN_BM    _BV(PB2)     /* OC1B */
+#define LED2_DDR       DDRB
+#define LED2_PIN_BM    _BV(PB3)     /* OC2A */
+#define LED3_DDR       DDRD
+#define LED3_PIN_BM    _BV(PD3)     /* OC2B */
+
+/* WS2812 strip on D8 (PB0), mirroring LED channel 0.  3 bytes of SRAM per
+ * pixel.  Bits are bit-banged with interrupts off, ~31 us per pixel.  A
+ * WS2812B may latch after only ~6-9 us of low (50 us is the guaranteed
+ * reset, not a safe gap), so an ISR between bytes can cut a frame short:
+ * by default (WS2812_CHUNK 0) the whole frame goes out in one go.  RX
+ * then relies on the 2-byte USART FIFO (~2 ms at 9600 baud, ~350 us at
+ * 57600) and a tick is lost past 1 ms, so keep strips short.
+ * WS2812_CHUNK > 0 lets ISRs run every that many pixels; only for parts
+ * that stay unlatched for as long as the longest ISR. */
+#if !FEAT_LED
+#undef  WS2812_ENABLE
+#define WS2812_ENABLE  0
+#endif
+#ifndef WS2812_ENABLE
+#define WS2812_ENABLE  0
+#endif
+#ifndef WS2812_PIXELS
+#define WS2812_PIXELS  30
+#endif
+#ifndef WS2812_CHUNK
+#define WS2812_CHUNK   0
+#endif
+#define WS2812_PORT    PORTB
+#define WS2812_DDR     DDRB
+#define WS2812_PIN_BM  _BV(PB0)
+
+/* Ambient light: the ADC free-runs at 125 kHz (~9.6 k conversions/s).
+ * Its interrupt sums 4^AMBIENT_OS_BITS samples into one (10 + OS_BITS)-bit
+ * reading and feeds an EMA with weight 2^-AMBIENT_EMA_SHIFT (6: ~0.1 s,
+ * which also averages out 100/120 Hz lamp flicker).  LED channels in
+ * AUTO brightness map the reading linearly from AMBIENT_BRIGHT_DARK
+ * (reading 0) to AMBIENT_BRIGHT_LIGHT (full scale) and only follow once
+ * the target is more than AMBIENT_HYST steps away. */
+#if !FEAT_LED
+#undef  AMBIENT_ENABLE
+#define AMBIENT_ENABLE 0
+#endif
+#ifndef AMBIENT_ENABLE
+#define AMBIENT_ENABLE 0
+#endif
+#define AMBIENT_ADC_CH        0
+#define AMBIENT_OS_BITS       2
+#define AMBIENT_EMA_SHIFT     6
+#ifndef AMBIENT_BRIGHT_DARK
+#define AMBIENT_BRIGHT_DARK   16
+#endif
+#ifndef AMBIENT_BRIGHT_LIGHT
+#define AMBIENT_BRIGHT_LIGHT  255
+#endif
+#define AMBIENT_HYST          8
+
 #define BUZZ_PORT      PORTD
 #define BUZZ_DDR       DDRD
 #define BUZZ_PIN_BM    _BV(PD6)
@@ -32,11 +242,104 @@
 #define LAMP_DDR       DDRD
 #define LAMP_PIN_BM    _BV(PD4)
 
+/* Longest reply frame, <TO>:#<seq>:<payload>:<NODE_ADDR>\n: a FROM longer
+ * than PROTO_ADDR_MAX gets no reply, and payloads are checked against
+ * PROTO_PAYLOAD_MAX at compile time (GET:ALL is the longest). */
+#define PROTO_ADDR_MAX     16U
+#define PROTO_PAYLOAD_MAX  (176U + 32U * (LED_CHANNELS - 1))
+#define PROTO_REPLY_MAX    (PROTO_ADDR_MAX + sizeof(":#65535:") - 1 + PROTO_PAYLOAD_MAX \
+                            + sizeof(":" NODE_ADDR "\n") - 1)
+
+/* RS-485 multi-drop: DE is raised only while we transmit and released on
+ * TX complete.  Replies to ALL go out in slot NODE_SLOT, i.e.
+ * RS485_GUARD_MS + NODE_SLOT * RS485_SLOT_MS after the request.  A slot
+ * carries PROTO_REPLY_MAX bytes at BAUD plus the idle gap: 221 ms at 9600,
+ * 41 ms at 57600 with one LED channel.  A deferred reply waits in the TX
+ * ring; up to RS485_HOLDS of them, further commands wait in the queue
+ * meanwhile.  Nothing starts while the bus has been busy within the last
+ * RS485_IDLE_MS. */
+#ifndef RS485_ENABLE
+#define RS485_ENABLE   0
+#endif
+#define RS485_DE_PORT  PORTD
+#define RS485_DE_DDR   DDRD
+#define RS485_DE_BM    _BV(PD2)
+
+#ifndef NODE_SLOT
+#define NODE_SLOT      0
+#endif
+#define RS485_GUARD_MS 5U
+#define RS485_IDLE_MS  3U
+#ifndef RS485_SLOT_MS
+#define RS485_SLOT_MS  ((uint16_t)((PROTO_REPLY_MAX * 10000UL + BAUD - 1) / BAUD \
+                                   + RS485_IDLE_MS + 1))
+#endif
+#define RS485_HOLDS    2
+
 /* Registration / retry */
 #define REG_ACK_TIMEOUT_MS   2000UL
-#define REG_RETRY_PERIOD_MS  5000UL
+#define REG_RETRY_PERIOD_MS  5000UL   /* first backoff, doubles per miss */
+#define REG_BACKOFF_MAX_MS   60000UL
+#define REG_BOOT_JITTER_MS   200U      /* spread power-up REGs of a fleet */
 
 /* Parser */
+#ifndef RX_LINE_MAX
 #define RX_LINE_MAX          256
+#endif
+
+/* Pipelining: a host should keep at most PROTO_PIPELINE_WINDOW "#<seq>"-
+ * tagged commands outstanding.  Advisory, the node does not count them:
+ * the queue keeps each sender's order, and a window that does not fit
+ * CMDQ_DEPTH fails the build (protocol.c). */
+#define PROTO_PIPELINE_WINDOW 4
+
+/* proto_poll() work budget per protocol task run.  Whatever is left
+ * stays in the RX ring / command queue and is resumed on the next run, so
+ * a due effects tick waits for at most one command (plus
+ * <= PROTO_BUDGET_BYTES of framing).  EEPROM commits are spread the same
+ * way, one byte per storage task run, see storage_poll(). */
+#define PROTO_BUDGET_LINES   1
+#define PROTO_BUDGET_BYTES   32
+#define PROTO_BUDGET_US      1000UL
+
+/* Command queue (cmdq.h) between framing and dispatch, sharing the
+ * RX_LINE_MAX pool.  Each sender (FROM) gets a token bucket of
+ * CMDQ_BURST commands refilled at CMDQ_RATE per second; queries also
+ * need CMDQ_RESERVE tokens left over, so a sender polling flat out can
+ * still actuate.  CMDQ_SOURCES buckets are kept; once all are taken a
+ * new sender inherits the fullest one, capped at CMDQ_RESERVE tokens. */
+#ifndef CMDQ_DEPTH
+#define CMDQ_DEPTH           8
+#endif
+#define CMDQ_SOURCES         4
+#define CMDQ_RATE            40
+#define CMDQ_BURST           8
+#define CMDQ_RESERVE         2
+
+/* Scheduler (sched.h): a task with a lower priority number runs first
+ * and the scan restarts at the top after every run (skipping the task
+ * that just ran if another is ready), so the bulk work (protocol) goes
+ * last.  SCHED_TASKS_MAX sizes the per-task accounting
+ * (36 B each); extra tasks run unaccounted. */
+#define SCHED_PRIO_EFFECTS   0
+#define SCHED_PRIO_ALARM     1
+#define SCHED_PRIO_STORAGE   2
+#define SCHED_PRIO_PROTO     3
+#define SCHED_PRIO_BOOT      4   /* one-shot deferred init, see boot.c */
+
+#ifndef SCHED_TASKS_MAX
+#define SCHED_TASKS_MAX      5
+#endif
+
+/* idle sleep when no task is due; 0 spins instead */
+#ifndef SCHED_IDLE_SLEEP
+#define SCHED_IDLE_SLEEP     1
+#endif
+
+/* Match the TO field inside the RX ISR and drop foreign lines before they
+ * reach the ring buffer; 0 passes every byte through to proto_poll(). */
+#ifndef RX_ADDR_FILTER
+#define RX_ADDR_FILTER       1
+#endif
 
 #endif /* __CONFIG_H__ */
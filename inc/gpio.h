@@ -16,6 +16,9 @@ void
 buzzer_set(uint8_t on);
 
 void
-led_pwm_set(uint8_t duty);
+pwm_set(uint8_t ch, uint8_t level); /* ch < LED_CHANNELS, perceptual 0..255 */
+
+uint16_t
+pwm_gamma(uint8_t level); /* lightness table, 0..65535 linear duty */
 
 #endif /* __GPIO_H__ */
@@ -2,6 +2,7 @@
 #define __LED_H__
 
 #include <stdint.h>
+#include "config.h"
 
 typedef enum
 {
@@ -16,24 +17,34 @@ typedef struct
     uint8_t       brightness;   /* 0..255 for SOLID      */
     uint8_t       actual_bright;   /* 0..255 for SOLID      */
     uint8_t       state;        /* on or off             */
+    uint8_t       auto_bright;  /* follow ambient light  */
 } led_state_t;
 
+/* Every PWM channel (0..LED_CHANNELS-1) has its own mode, brightness
+ * and effect phase; all of them advance on one shared effects frame. */
 void
 effects_init(void);
 
 void
-effects_set_mode(led_mode_t mode);
+effects_set_mode(uint8_t ch, led_mode_t mode);
 
 void
-effects_set_state(uint8_t state);
+effects_set_state(uint8_t ch, uint8_t state);
 
 void
-effects_set_brightness(uint8_t b);
+effects_set_brightness(uint8_t ch, uint8_t b);
 
-led_state_t
-effects_get(void);
+void
+effects_fade_to(uint8_t ch, uint8_t b, uint16_t ms); /* linear, cancelled by set_brightness */
 
 void
-effects_tick_1ms(void); /* call from main loop each ms tick */
+effects_set_auto(uint8_t ch, uint8_t on); /* no-op without AMBIENT_ENABLE */
+
+led_state_t
+effects_get(uint8_t ch);
+
+/* frames and ramps run in the EFFECTS scheduler task */
+uint32_t
+effects_tick_gap_max(void); /* worst us a due tick ran late, cleared on read */
 
 #endif /* __LED_H__ */
@@ -0,0 +1,54 @@
+#ifndef __LOOPSTAT_H__
+#define __LOOPSTAT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+/* Per-task run-time accounting and stall detection, fed by the scheduler.
+ * Each task's run time feeds a log2 histogram: bucket 0 is < 8 us,
+ * bucket i covers [4 << i, 8 << i) us, the last one is open-ended.
+ * Tasks past LOOPSTAT_SLOTS still run but are not accounted.
+ * The watchdog runs in interrupt+reset mode: if no scheduler scan
+ * completes within LOOPSTAT_WDT_TIMEOUT the ISR notes the running task
+ * in .noinit SRAM, the next timeout resets the MCU, and the task is
+ * reported after boot.
+ */
+
+#define LOOPSTAT_SLOTS        SCHED_TASKS_MAX
+#define LOOPSTAT_BUCKETS      12
+#define LOOPSTAT_STALL_SCHED  0xFE   /* between tasks */
+#define LOOPSTAT_STALL_NONE   0xFF
+
+typedef struct
+{
+    uint32_t runs;
+    uint32_t busy_ms;   /* total run time */
+    uint32_t max_us;
+} loopstat_task_t;
+
+void
+loopstat_init(void); /* arms the watchdog, call right before sched_run */
+
+void
+loopstat_enter(uint8_t id); /* task id is about to run */
+
+uint32_t
+loopstat_account(uint8_t id, uint32_t t_start); /* returns now (us) */
+
+void
+loopstat_pass(void); /* a scan completed: feed the watchdog */
+
+const uint16_t *
+loopstat_hist(uint8_t id); /* NULL past LOOPSTAT_SLOTS */
+
+bool
+loopstat_get(uint8_t id, loopstat_task_t *out);
+
+uint8_t
+loopstat_reset_flags(void); /* MCUSR as found at reset */
+
+uint8_t
+loopstat_stall(void); /* task that stalled before the last reset, SCHED or NONE */
+
+#endif /* __LOOPSTAT_H__ */
@@ -0,0 +1,30 @@
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include <stdint.h>
+
+/* SRAM budget instrumentation.
+ * The gap between .bss and the stack is painted with MEM_CANARY before
+ * main() runs; the lowest overwritten byte gives the stack high-water mark.
+ * Heap usage is read from avr-libc's malloc bookkeeping.
+ */
+
+#define MEM_CANARY 0xC5
+
+typedef struct
+{
+    uint16_t static_sz;   /* .data + .bss (+ .noinit)                  */
+    uint16_t heap_cur;    /* current break - __heap_start               */
+    uint16_t heap_peak;   /* highest break seen by mem_sample()         */
+    uint16_t heap_free;   /* bytes on the malloc free list              */
+    uint16_t stack_peak;  /* deepest stack use since boot               */
+    uint16_t stack_gap;   /* never-touched bytes between heap and stack */
+} mem_stats_t;
+
+void
+mem_sample(void); /* cheap: records heap break peak, call after mallocs */
+
+void
+mem_stats(mem_stats_t *out); /* scans the painted region, O(gap) */
+
+#endif /* __MEM_H__ */
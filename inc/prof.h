@@ -0,0 +1,39 @@
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+/* Statistical PC-sampling profiler.  Addresses are flash word addresses
+ * (byte address / 2), as they sit on the stack.  Bucket i counts samples
+ * in [base + (i << shift), base + ((i + 1) << shift)); anything outside
+ * the window counts as "out".  Sampling stops by itself once the sample
+ * count would overflow, so ratios stay exact.
+ */
+
+typedef struct
+{
+    uint16_t samples;
+    uint16_t out;       /* samples outside the window */
+    uint16_t base;      /* word address of bucket 0   */
+    uint8_t  shift;     /* log2 words per bucket      */
+    bool     running;
+} prof_info_t;
+
+void
+prof_start(uint16_t base, uint8_t shift); /* clears the histogram */
+
+void
+prof_stop(void);
+
+void
+prof_tick(void); /* from TIMER0_COMPA_vect: bins the last sample */
+
+void
+prof_info(prof_info_t *out);
+
+uint16_t
+prof_bucket(uint8_t i);
+
+#endif /* __PROF_H__ */
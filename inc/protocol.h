@@ -16,7 +16,10 @@ typedef enum
 } app_state_t;
 
 void
-proto_init(void);
+proto_init(void); /* queue, saved state and outputs: enough to answer */
+
+void
+proto_boot(void); /* trace ring, PRNG seed, first REG: from the BOOT task */
 
 void
 proto_poll(void); /* consume RX, process lines, emit replies */
@@ -24,14 +27,25 @@ proto_poll(void); /* consume RX, process lines, emit replies */
 app_state_t
 proto_get_state(void);
 
+/* `to` is always in RAM; the _P variants take payload/topic/reason
+ * from flash (PSTR / PROGMEM) so constant replies cost no SRAM. */
 void
 proto_send(const char *to, const char *payload);
 
+void
+proto_send_P(const char *to, const char *payload_P);
+
 /* helpers for building replies */
 void
 proto_send_ok(const char *topic, const char *to);
 
+void
+proto_send_ok_P(const char *topic_P, const char *to);
+
 void
 proto_send_error(const char *topic, const char *reason, const char *to);
 
+void
+proto_send_error_P(const char *topic_P, const char *reason_P, const char *to);
+
 #endif /* PROTOCOL_H */
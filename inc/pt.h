@@ -0,0 +1,38 @@
+#ifndef __PT_H__
+#define __PT_H__
+
+#include <stdint.h>
+
+/* Stackless protothreads (after A. Dunkels): the resume point is a line
+ * number kept in a pt_t and the body is one big switch, so locals do not
+ * survive a wait - keep task state in statics.  No switch statements
+ * directly inside a protothread body.
+ */
+
+typedef uint16_t pt_t;
+
+enum
+{
+    PT_WAITING = 0,
+    PT_YIELDED = 1,
+    PT_EXITED  = 2,
+    PT_ENDED   = 3
+};
+
+#define PT_INIT(pt)     (*(pt) = 0)
+#define PT_BEGIN(pt)    switch (*(pt)) { case 0:
+#define PT_END(pt)      } *(pt) = 0; return PT_ENDED
+
+#define PT_YIELD(pt) \
+    do { *(pt) = __LINE__; return PT_YIELDED; case __LINE__:; } while (0)
+
+#define PT_WAIT_UNTIL(pt, cond) \
+    do {                                                      \
+        *(pt) = __LINE__; __attribute__((fallthrough));       \
+        case __LINE__: if (!(cond)) { return PT_WAITING; }    \
+    } while (0)
+
+#define PT_EXIT(pt) \
+    do { *(pt) = 0; return PT_EXITED; } while (0)
+
+#endif /* __PT_H__ */
@@ -0,0 +1,91 @@
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "pt.h"
+#include "timer.h"
+
+/* Cooperative scheduler for protothread tasks.
+ * A task names the events it waits for; a scan checks the tasks in
+ * priority order (0 first) and runs the first one that is woken, then
+ * starts over at the top.  The task that ran last is passed over once
+ * if any other is woken, so one that stays ready cannot starve the
+ * lower ones.  A scan that finds nothing to run idles the
+ * CPU until the next interrupt (at least the 1 ms tick).  Every run is
+ * timed into loopstat under the task's id.
+ *
+ * Tasks register themselves with SCHED_TASK() from their own module, so
+ * adding one does not touch main():
+ *
+ *     SCHED_TASK(s_foo_task, foo_task, "FOO", SCHED_PRIO_FOO);
+ *
+ *     static char
+ *     foo_task(sched_task_t *t)
+ *     {
+ *         PT_BEGIN(&t->pt);
+ *         for (;;)
+ *         {
+ *             foo_work();
+ *             SCHED_SLEEP(t, 100);
+ *         }
+ *         PT_END(&t->pt);
+ *     }
+ */
+
+#define SCHED_EV_TIMER   0x01   /* t->due (ms) reached          */
+#define SCHED_EV_RX      0x02   /* UART RX ring not empty       */
+#define SCHED_EV_EEPROM  0x04   /* EEPROM idle, a write is done */
+#define SCHED_EV_SIGNAL  0x08   /* sched_signal() since last run */
+#define SCHED_EV_NOW     0x80   /* next scan, i.e. plain yield  */
+
+typedef struct sched_task sched_task_t;
+typedef char (*sched_fn_t)(sched_task_t *t);
+
+struct sched_task
+{
+    sched_fn_t        fn;
+    const char       *name_P;
+    uint8_t           prio;
+    uint8_t           id;       /* position in priority order, set by sched_run */
+    uint8_t           wait;     /* SCHED_EV_* that wake it, 0 once ended */
+    volatile uint8_t  signal;
+    uint32_t          due;
+    pt_t              pt;
+    sched_task_t     *next;
+};
+
+#define SCHED_TASK(var, fn, name, prio)                                   \
+    static char fn(sched_task_t *t);                                      \
+    static const char var##_name[] PROGMEM = name;                        \
+    static sched_task_t var = { fn, var##_name, prio, 0, SCHED_EV_NOW, 0, 0, 0, NULL }; \
+    static void var##_reg(void) __attribute__((constructor));             \
+    static void var##_reg(void) { sched_add(&var); }
+
+#define SCHED_WAIT(t, ev) \
+    do { (t)->wait = (ev); PT_YIELD(&(t)->pt); } while (0)
+
+/* wake at ms 'when' or on any of 'ev' */
+#define SCHED_WAIT_UNTIL(t, when, ev) \
+    do { (t)->due = (when); SCHED_WAIT(t, SCHED_EV_TIMER | (ev)); } while (0)
+
+#define SCHED_SLEEP(t, ms) \
+    SCHED_WAIT_UNTIL(t, timer_now() + (ms), 0)
+
+void
+sched_add(sched_task_t *t); /* keeps the list in priority order */
+
+void
+sched_signal(sched_task_t *t); /* ISR safe */
+
+void
+sched_run(void) __attribute__((noreturn));
+
+uint8_t
+sched_count(void);
+
+const sched_task_t *
+sched_task(uint8_t id); /* NULL past the end */
+
+#endif /* __SCHED_H__ */
@@ -0,0 +1,51 @@
+#ifndef __STATE_H__
+#define __STATE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+/* Versioned snapshot of the externally visible node state.
+ * Every observed change bumps a global version counter and stamps the
+ * changed field with it, so a host can ask for "everything since <ver>".
+ * Versions are 16-bit and compared with serial-number arithmetic; a
+ * host 0x8000 or more versions away (or at 0) gets every field back.
+ * LED channel 0 owns STATE_LED..STATE_BRIGHT; channels 1.. follow
+ * STATE_ALARM with one LED/MODE/BRIGHT triple each.
+ */
+
+typedef enum
+{
+    STATE_LAMP   = 0,
+    STATE_LED    = 1,
+    STATE_MODE   = 2,
+    STATE_BRIGHT = 3,
+    STATE_ALARM  = 4,
+    STATE_CH_BASE = 5,
+    STATE_FIELD_COUNT = STATE_CH_BASE + 3 * (LED_CHANNELS - 1)
+} state_field_t;
+
+#if FEAT_STATE
+void
+state_init(void);
+
+void
+state_sync(void); /* compare live state against snapshot, stamp changes */
+
+uint16_t
+state_version(void);
+
+uint8_t
+state_value(state_field_t f);
+
+bool
+state_changed_since(state_field_t f, uint16_t ver);
+
+state_field_t
+state_field_kind(state_field_t f, uint8_t *ch); /* STATE_LAMP..ALARM + channel */
+#else
+static inline void state_init(void) {}
+static inline void state_sync(void) {}
+#endif
+
+#endif /* __STATE_H__ */
@@ -1,6 +1,7 @@
 #ifndef STORAGE_H
 #define STORAGE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include "led.h"
 
@@ -9,15 +10,52 @@ typedef struct
     uint32_t      magic;        /* 'VX01'                 */
     uint8_t       version;      /* struct version         */
     uint8_t       lamp_on;      /* 0/1                    */
-    led_state_t   led;          /* mode + brightness      */
+#if FEAT_LED
+    led_state_t   led[LED_CHANNELS]; /* mode + brightness per channel */
+#endif
     uint8_t       crc8;         /* Dallas/Maxim poly 0x31 */
 } nv_state_t;
 
+/* A stored scene: everything LOAD:PRESET applies in one step */
+typedef struct
+{
+    uint8_t       tag;          /* PRESET_TAG once written */
+    uint8_t       lamp_on;      /* relay level, as nv_state_t */
+#if FEAT_LED
+    led_state_t   led[LED_CHANNELS];
+#endif
+    uint8_t       alarm_mode;   /* AlarmMode              */
+    uint8_t       crc8;
+} preset_t;
+
 void
 storage_load(nv_state_t *out);
 
 void
-storage_save(const nv_state_t *st);
+storage_defaults(nv_state_t *out);
+
+void
+storage_seal(nv_state_t *st); /* stamp magic, version and crc8 */
+
+bool
+storage_check(const nv_state_t *st); /* magic, version and crc8 valid */
+
+void
+storage_save(const nv_state_t *st); /* queues the commit, see storage_poll */
+
+void
+storage_poll(void); /* writes queued bytes while the EEPROM is idle */
+
+uint8_t
+storage_busy(void);
+
+#if FEAT_PRESET
+bool
+storage_preset_get(uint8_t n, preset_t *out); /* false: n out of range or slot empty */
+
+void
+storage_preset_put(uint8_t n, const preset_t *p); /* queued like storage_save */
+#endif
 
 uint8_t
 crc8_dallas(const uint8_t *p, uint8_t len);
@@ -43,6 +43,9 @@ timer_init(void);
 uint32_t
 timer_now(void);
 
+uint32_t
+timer_now_us(void); /* microseconds, resolution one Timer0 count (4 us @16MHz) */
+
 bool
 timer_reached(uint32_t now, uint32_t target);
 
@@ -66,10 +69,15 @@ timer_stop(Timer *t);
 bool
 timer_timeout(Timer *t);
 
+uint32_t
+timer_deadline(const Timer *t); /* ms it fires next, while started */
+
 #endif /* __TIMER_H__ */
 
 #ifdef TIMER_IMPL
 
+#include "prof.h"
+
 #ifndef TIMER_AVR_EXTERNAL_MILLIS
 volatile uint32_t g_millis = 0;
 
@@ -95,7 +103,31 @@ timer_init(void)
 }
 
 ISR(TIMER0_COMPA_vect)
-{ g_millis++; }
+{
+    g_millis++;
+#if PROF_ENABLE
+    prof_tick();
+#endif
+}
+
+uint32_t
+timer_now_us(void)
+{
+#ifdef TIMER0_OCR_FOR_1MS
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t ms  = g_millis;
+    uint8_t  cnt = TCNT0;
+    /* compare match already happened but its ISR has not run yet */
+    if ((TIFR0 & _BV(OCF0A)) && cnt < TIMER0_OCR_FOR_1MS)
+    { ms++; }
+    SREG = sreg;
+
+    return ms * 1000UL + (uint32_t)cnt * (1000UL / (TIMER0_OCR_FOR_1MS + 1UL));
+#else
+    return timer_now() * 1000UL;
+#endif
+}
 
 #else  /* TIMER_AVR_EXTERNAL_MILLIS */
 
@@ -107,6 +139,12 @@ timer_init(void)
     /* No-op: external project must increment g_millis every 1 ms */
 }
 
+uint32_t
+timer_now_us(void)
+{
+    return timer_now() * 1000UL;
+}
+
 #endif /* TIMER_AVR_EXTERNAL_MILLIS */
 
 uint32_t
@@ -167,4 +205,10 @@ timer_timeout(Timer *t)
     return true;
 }
 
+uint32_t
+timer_deadline(const Timer *t)
+{
+    return t->target;
+}
+
 #endif /* TIMER_IMPL */
@@ -0,0 +1,57 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "config.h"
+
+/* Flight recorder: fixed ring of the last TRACE_DEPTH commands/events.
+ * The ring lives in .noinit SRAM, so it survives watchdog and external
+ * resets (not power loss); a BOOT entry separates runs.
+ */
+
+#ifndef TRACE_DEPTH
+#define TRACE_DEPTH 16
+#endif
+
+/* event ids share the verb slot with protocol verb ids */
+#define TRACE_EV_BOOT     0xF0
+#define TRACE_EV_RXOVF    0xF1   /* UART ring overflow, dur = bytes lost */
+#define TRACE_EV_LINEOVF  0xF2   /* line longer than RX_LINE_MAX (GEN:OVF) */
+#define TRACE_EV_FORMAT   0xF3   /* unparsable packet (PROTO:FORMAT) */
+
+typedef enum
+{
+    TRACE_RES_NONE = 0,  /* handled, no reply */
+    TRACE_RES_OK   = 1,
+    TRACE_RES_ERR  = 2
+} trace_result_t;
+
+typedef struct
+{
+    uint32_t t_ms;       /* timer_now() at completion      */
+    uint8_t  verb;       /* protocol verb id or TRACE_EV_* */
+    uint8_t  noun;       /* protocol noun id               */
+    uint8_t  result;     /* trace_result_t                 */
+    uint16_t dur_us;     /* handling time, saturating      */
+} trace_entry_t;
+
+#if FEAT_TRACE
+void
+trace_init(void);
+
+void
+trace_record(uint8_t verb, uint8_t noun, uint8_t result, uint16_t dur_us);
+
+uint8_t
+trace_count(void);
+
+bool
+trace_get(uint8_t idx, trace_entry_t *out); /* idx 0 = oldest */
+#else
+static inline void trace_init(void) {}
+static inline void trace_record(uint8_t verb, uint8_t noun, uint8_t result, uint16_t dur_us)
+{ (void)verb; (void)noun; (void)result; (void)dur_us; }
+#endif
+
+#endif /* __TRACE_H__ */
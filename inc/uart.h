@@ -1,10 +1,14 @@
 #ifndef UART_H
 #define UART_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
-/* Non-blocking UART with IRQ-driven TX/RX ring buffers. */
+/* Non-blocking UART with IRQ-driven TX/RX ring buffers.
+ * With RS485_ENABLE the TX side is gated: queued bytes wait until the bus
+ * is idle, and a deferred frame waits in the ring until its time (later
+ * frames queue behind it); uart_poll() opens the gate. */
 
 void
 uart_init(uint32_t baud);
@@ -15,10 +19,33 @@ uart_write(const uint8_t *data, size_t len);
 size_t
 uart_write_str(const char *s);
 
+size_t
+uart_write_str_P(const char *s); /* s points into flash (PROGMEM) */
+
 int
 uart_read_byte(uint8_t *out); /* returns 1 if a byte was read, 0 if none */
 
+int
+uart_rx_pending(void); /* a byte is waiting, see uart_read_byte */
+
 int
 uart_tx_idle(void);
 
+void
+uart_poll(void); /* RS-485 TX gate; no-op on a point-to-point link */
+
+bool
+uart_tx_defer(uint16_t ms); /* hold the frame written next back ms (RS-485);
+                               false if RS485_HOLDS frames wait already */
+
+bool
+uart_tx_ready(uint16_t len); /* len bytes (at most the whole ring) fit, and on
+                                RS-485 a hold is free: writing never waits */
+
+uint16_t
+uart_rx_filtered(void); /* foreign lines dropped by the ISR address filter */
+
+uint16_t
+uart_rx_overflows(void); /* bytes lost to RX ring overflow */
+
 #endif /* UART_H */
@@ -2,8 +2,27 @@
 #define __UTIL_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 
 bool
 parse_packet_alloc(const char *packet, char **to, char **payload, char **from);
 
+bool
+parse_packet_inplace(char *packet, char **to, char **payload, char **from);
+
+/* out must hold 2*len+1 chars; upper-case, NUL-terminated */
+void
+hex_encode(const uint8_t *in, uint8_t len, char *out);
+
+/* exactly 2*len hex digits expected; false on bad length or digit */
+bool
+hex_decode(const char *in, uint8_t *out, uint8_t len);
+
+/* xorshift32 over .noinit SRAM, mixed with whatever the caller adds */
+void
+prng_seed(uint32_t mix);
+
+uint16_t
+prng_next(void);
+
 #endif /* __UTIL_H__ */
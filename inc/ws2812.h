@@ -0,0 +1,30 @@
+#ifndef __WS2812_H__
+#define __WS2812_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* WS2812 / WS2812B output on WS2812_PORT, 800 kHz, 16 MHz only.
+ * Pixels are kept in a GRB framebuffer; a frame goes out on
+ * ws2812_show() only if a pixel actually changed since the last one.
+ */
+
+void
+ws2812_init(void);
+
+void
+ws2812_set(uint16_t i, uint8_t r, uint8_t g, uint8_t b);
+
+void
+ws2812_fill(uint8_t r, uint8_t g, uint8_t b);
+
+bool
+ws2812_show(void); /* sends a dirty frame, false if there was none */
+
+uint16_t
+ws2812_frames(void);
+
+uint16_t
+ws2812_frame_us(void); /* duration of the last frame incl. ISR gaps */
+
+#endif /* __WS2812_H__ */
@@ -1,55 +1,267 @@
 #include "alarm.h"
 #include "gpio.h"
 #include "timer.h"
+#include "sched.h"
+#include "config.h"
 
-static Alarm s_alarm = { .mode = ALARM_MODE_OFF };
-static Timer s_alarm_tim;
+#if FEAT_ALARM
+
+#define ALARM_PHASE_WAIT 0xFF /* silent until the next frame starts it */
+
+/* one active pattern, times in effects frames */
+typedef struct
+{
+    uint8_t  prio;
+    uint8_t  period;  /* 0 = solid */
+    uint8_t  on;      /* frames sounding per period */
+    uint8_t  phase;
+    uint8_t  repeat;  /* periods left, 0 = endless */
+    uint16_t left;    /* frames left, 0 = endless */
+} alarm_slot_t;
+
+/* highest priority first; the mode slot (prio 0) comes on top of
+   ALARM_PATTERNS so commands can never push the stored mode out */
+static alarm_slot_t s_slot[ALARM_PATTERNS + 1];
+static uint8_t      s_count  = 0;
+static AlarmMode    s_mode   = ALARM_MODE_OFF;
+static bool         s_out    = false;
+static uint8_t      s_frames = 0;      /* frames not stepped yet */
+#if !FEAT_LED
+static uint32_t     s_frame_due = 0;   /* own frame clock */
+#endif
+
+SCHED_TASK(s_alarm_task, alarm_task, "ALARM", SCHED_PRIO_ALARM)
+
+static uint16_t
+to_frames(uint32_t ms)
+{
+    uint32_t f = (ms + EFFECTS_FRAME_MS / 2) / EFFECTS_FRAME_MS;
+    if (f == 0)          { f = 1; }
+    if (f > UINT16_MAX)  { f = UINT16_MAX; }
+    return (uint16_t)f;
+}
+
+/* the winner decides, every change goes out at once */
+static void
+alarm_output(void)
+{
+    const alarm_slot_t *s  = &s_slot[0];
+    bool                on = s_count && (!s->period || s->phase < s->on);
+    if (on != s_out)
+    {
+        s_out = on;
+        buzzer_set(on);
+    }
+}
+
+static void
+remove_slot(uint8_t i)
+{
+    if (s_slot[i].prio == ALARM_PRIO_MODE)
+    { s_mode = ALARM_MODE_OFF; }
+    for (; i + 1 < s_count; i++)
+    { s_slot[i] = s_slot[i + 1]; }
+    s_count--;
+}
+
+static int8_t
+find_slot(uint8_t prio)
+{
+    for (uint8_t i = 0; i < s_count; i++)
+    {
+        if (s_slot[i].prio == prio)
+        { return (int8_t)i; }
+    }
+    return -1;
+}
+
+/* one frame for every pattern, including the ones not sounding */
+static void
+alarm_step(void)
+{
+    for (uint8_t i = 0; i < s_count;)
+    {
+        alarm_slot_t *s = &s_slot[i];
+        if (s->phase == ALARM_PHASE_WAIT)
+        {
+            s->phase = 0;
+            i++;
+            continue;
+        }
+
+        bool done = s->left && --s->left == 0;
+        if (s->period && ++s->phase >= s->period)
+        {
+            s->phase = 0;
+            if (s->repeat && --s->repeat == 0)
+            { done = true; }
+        }
+        if (done)
+        { remove_slot(i); }
+        else
+        { i++; }
+    }
+}
 
 void
 alarm_init(void)
 {
-    s_alarm.mode = ALARM_MODE_OFF;
-    s_alarm.blink = false;
+    s_count = 0;
+    s_mode  = ALARM_MODE_OFF;
+    s_out   = false;
     buzzer_set(false);
-    timer_set(&s_alarm_tim, 500, true);
 }
 
 void
 alarm_set_mode(AlarmMode mode)
 {
-    s_alarm.mode = mode;
+    AlarmPattern p = { ALARM_PRIO_MODE, 0, 100, 0, 0 };
+
     if (mode == ALARM_MODE_OFF)
     {
-        buzzer_set(false);
+        alarm_stop(ALARM_PRIO_MODE);
+        return;
+    }
+    if (mode == ALARM_MODE_BLINK)
+    {
+        p.period_ms = 1000; /* 500 ms on, 500 ms off */
+        p.duty      = 50;
     }
-    else if (mode == ALARM_MODE_SOLID)
+    alarm_start(&p);
+    s_mode = mode;
+}
+
+AlarmMode
+alarm_get_mode(void)
+{
+    return s_mode;
+}
+
+bool
+alarm_start(const AlarmPattern *p)
+{
+    alarm_slot_t s = { p->prio, 0, 0, 0, p->repeat, 0 };
+
+    if (p->period_ms)
+    {
+        uint16_t f = to_frames(p->period_ms);
+        s.period = f > UINT8_MAX ? UINT8_MAX : (uint8_t)f;
+        s.on     = (uint8_t)(((uint16_t)s.period * (p->duty > 100 ? 100 : p->duty) + 50) / 100);
+        s.phase  = ALARM_PHASE_WAIT; /* whole first beep, on the frame */
+    }
+    if (p->left_ms)
+    { s.left = to_frames(p->left_ms); }
+
+    int8_t old = find_slot(p->prio);
+    if (old >= 0)
+    { remove_slot((uint8_t)old); }
+
+    uint8_t n = s_count;
+    if (n && s_slot[n - 1].prio == ALARM_PRIO_MODE)
+    { n--; }
+    if (p->prio != ALARM_PRIO_MODE && n == ALARM_PATTERNS)
+    {
+        if (s_slot[n - 1].prio >= p->prio)
+        { return false; }
+        remove_slot(n - 1);
+    }
+
+    if (!s_count)
     {
-        buzzer_set(true);
+        s_frames = 0; /* left over from the last pattern */
+#if !FEAT_LED
+        s_frame_due = timer_now() + EFFECTS_FRAME_MS;
+#endif
     }
-    else
+    uint8_t i = s_count;
+    for (; i > 0 && s_slot[i - 1].prio < p->prio; i--)
+    { s_slot[i] = s_slot[i - 1]; }
+    s_slot[i] = s;
+    s_count++;
+
+    alarm_output();
+    sched_signal(&s_alarm_task);
+    return true;
+}
+
+void
+alarm_stop(uint8_t prio)
+{
+    int8_t i = find_slot(prio);
+    if (i >= 0)
     {
-        timer_start(&s_alarm_tim);
-        s_alarm.blink = true;
+        remove_slot((uint8_t)i);
+        alarm_output();
     }
 }
 
 void
-alarm_loop(void)
+alarm_stop_all(void)
+{
+    s_count = 0;
+    s_mode  = ALARM_MODE_OFF;
+    alarm_output();
+}
+
+bool
+alarm_pattern(uint8_t i, AlarmPattern *out)
+{
+    if (i >= s_count)
+    { return false; }
+
+    const alarm_slot_t *s = &s_slot[i];
+    out->prio      = s->prio;
+    out->period_ms = (uint16_t)(s->period * EFFECTS_FRAME_MS);
+    out->duty      = s->period ? (uint8_t)((s->on * 100U + s->period / 2) / s->period) : 100;
+    out->repeat    = s->repeat;
+    out->left_ms   = (uint32_t)s->left * EFFECTS_FRAME_MS;
+    return true;
+}
+
+bool
+alarm_sounding(void)
+{
+    return s_out;
+}
+
+/* called by the EFFECTS task on every frame */
+void
+alarm_frame(void)
 {
-    if (!timer_timeout(&s_alarm_tim))
+    if (!s_count)
     { return; }
+    if (s_frames < UINT8_MAX)
+    { s_frames++; }
+    sched_signal(&s_alarm_task);
+}
 
-    switch (s_alarm.mode)
+/* runs right after EFFECTS on a frame (or on its own frame clock
+   without LEDs); starts and stops drive the buzzer directly */
+static char
+alarm_task(sched_task_t *t)
+{
+    PT_BEGIN(&t->pt);
+    for (;;)
     {
-        case ALARM_MODE_OFF:
-        case ALARM_MODE_SOLID:
-            /* nothing */
-            break;
-        case ALARM_MODE_BLINK:
+#if FEAT_LED
+        SCHED_WAIT(t, SCHED_EV_SIGNAL);
+#else
+        if (s_count)
+        { SCHED_WAIT_UNTIL(t, s_frame_due, SCHED_EV_SIGNAL); }
+        else
+        { SCHED_WAIT(t, SCHED_EV_SIGNAL); }
+        while (s_count && timer_reached(timer_now(), s_frame_due))
         {
-            buzzer_set(s_alarm.blink);
-            s_alarm.blink = !s_alarm.blink;
-        } break;
+            if (s_frames < UINT8_MAX)
+            { s_frames++; }
+            s_frame_due += EFFECTS_FRAME_MS;
+        }
+#endif
+        for (; s_frames; s_frames--)
+        { alarm_step(); }
+        alarm_output();
     }
+    PT_END(&t->pt);
 }
 
+#endif /* FEAT_ALARM */
@@ -0,0 +1,77 @@
+#include "ambient.h"
+#include "config.h"
+
+#if AMBIENT_ENABLE
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdbool.h>
+
+#define AMBIENT_BITS  (10 + AMBIENT_OS_BITS)
+#define EMA_FRAC      (16 - AMBIENT_BITS)   /* fraction bits kept in s_ema */
+
+static volatile uint16_t s_ema  = 0;        /* reading << EMA_FRAC */
+static volatile bool     s_primed = false;
+static uint16_t          s_acc  = 0;
+static uint8_t           s_n    = 0;
+
+void
+ambient_init(void)
+{
+    DIDR0  |= _BV(AMBIENT_ADC_CH);          /* no digital input buffer */
+    ADMUX   = _BV(REFS0) | AMBIENT_ADC_CH;  /* AVcc reference */
+    ADCSRB  = 0;                            /* auto trigger: free running */
+    ADCSRA  = _BV(ADEN) | _BV(ADATE) | _BV(ADIE)
+            | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); /* /128 = 125 kHz */
+    ADCSRA |= _BV(ADSC);
+}
+
+ISR(ADC_vect)
+{
+    s_acc += ADC;
+    if (++s_n < (1U << (2 * AMBIENT_OS_BITS)))
+    { return; }
+
+    /* decimate: 4^n samples summed, >> n gives n extra bits */
+    uint16_t x = (uint16_t)(s_acc >> AMBIENT_OS_BITS) << EMA_FRAC;
+    s_acc = 0;
+    s_n   = 0;
+
+    if (!s_primed)
+    {
+        s_ema    = x;
+        s_primed = true;
+        return;
+    }
+    s_ema = (uint16_t)(s_ema + (((int32_t)x - (int32_t)s_ema) >> AMBIENT_EMA_SHIFT));
+}
+
+uint16_t
+ambient_raw(void)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t v = s_ema;
+    SREG = sreg;
+    return v >> EMA_FRAC;
+}
+
+uint8_t
+ambient_level(void)
+{
+    return (uint8_t)(ambient_raw() >> (AMBIENT_BITS - 8));
+}
+
+uint8_t
+ambient_brightness(uint8_t current)
+{
+    int16_t span   = (int16_t)AMBIENT_BRIGHT_LIGHT - (int16_t)AMBIENT_BRIGHT_DARK;
+    int16_t target = (int16_t)(AMBIENT_BRIGHT_DARK + ((int32_t)span * ambient_level()) / 255);
+
+    int16_t d = target - (int16_t)current;
+    if (d <= AMBIENT_HYST && d >= -AMBIENT_HYST)
+    { return current; }
+    return (uint8_t)target;
+}
+
+#endif /* AMBIENT_ENABLE */
@@ -0,0 +1,44 @@
+#include "boot.h"
+#include "sched.h"
+#include "ambient.h"
+#include "protocol.h"
+#include "config.h"
+
+static uint32_t s_at[BOOT_PHASE_COUNT];
+static uint8_t  s_done = 0;  /* bit per phase */
+
+SCHED_TASK(s_boot_task, boot_task, "BOOT", SCHED_PRIO_BOOT)
+
+void
+boot_mark(boot_phase_t p)
+{
+    if (s_done & _BV(p))
+    { return; }
+    s_at[p]  = timer_now_us();
+    s_done  |= (uint8_t)_BV(p);
+}
+
+bool
+boot_at(boot_phase_t p, uint32_t *us)
+{
+    if (!(s_done & _BV(p)))
+    { return false; }
+    *us = s_at[p];
+    return true;
+}
+
+/* Init that the node does not need to take commands, run once at the
+   lowest priority: after the first pass of every other task and any
+   command that is already waiting. Present in every profile: the trace
+   ring check, PRNG seeding and the first REG are always deferred. */
+static char
+boot_task(sched_task_t *t)
+{
+    PT_BEGIN(&t->pt);
+    proto_boot();
+#if AMBIENT_ENABLE
+    ambient_init();  /* the level average settles over ~0.1 s anyway */
+#endif
+    boot_mark(BOOT_DEFER);
+    PT_END(&t->pt);
+}
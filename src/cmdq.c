@@ -0,0 +1,310 @@
+#include "cmdq.h"
+#include "timer.h"
+#include "config.h"
+
+#include <avr/pgmspace.h>
+#include <string.h>
+
+#define CMDQ_POOL  RX_LINE_MAX
+#define CMDQ_FULL  ((uint16_t)(CMDQ_BURST * 1000U))  /* milli-tokens */
+
+typedef struct
+{
+    uint16_t off;
+    uint16_t len;   /* including the NUL */
+    uint16_t src;   /* hash of FROM */
+    uint16_t t;     /* admitted, ms (low bits) */
+    bool     act;   /* actuation verb */
+} cmdq_ent_t;
+
+typedef struct
+{
+    uint16_t src;
+    uint16_t milli; /* tokens * 1000 */
+    uint32_t t;     /* last refill, ms */
+    bool     used;
+} cmdq_bucket_t;
+
+static char          s_pool[CMDQ_POOL];
+static uint16_t      s_used    = 0;      /* bytes of queued lines        */
+static uint16_t      s_tail    = 0;      /* bytes of the line in framing */
+static cmdq_ent_t    s_ent[CMDQ_DEPTH];  /* arrival order                */
+static uint8_t       s_n       = 0;
+static int8_t        s_busy    = -1;     /* handed out by cmdq_next      */
+static cmdq_bucket_t s_bkt[CMDQ_SOURCES];
+static cmdq_stats_t  s_st;
+static cmdq_reject_fn s_reject = NULL;
+
+static const char s_act_verbs[] PROGMEM = "ON\0OFF\0TOGGLE\0SET\0SAVE\0LOAD\0REG\0";
+
+static void
+remove_entry(uint8_t i)
+{
+    uint16_t off = s_ent[i].off;
+    uint16_t len = s_ent[i].len;
+
+    /* later lines and the one in framing move down */
+    memmove(&s_pool[off], &s_pool[off + len], (size_t)(s_used + s_tail - off - len));
+    s_used -= len;
+    for (; i + 1 < s_n; i++)
+    {
+        s_ent[i]      = s_ent[i + 1];
+        s_ent[i].off -= len;
+    }
+    s_n--;
+}
+
+/* the hook answers the line before its bytes go */
+static void
+reject(char *line, cmdq_res_t why)
+{
+    if (why == CMDQ_THROTTLED)
+    { s_st.throttled++; }
+    else
+    { s_st.shed++; }
+    if (s_reject)
+    { s_reject(line, why); }
+}
+
+/* newest queued query goes first when room is short */
+static bool
+evict_query(void)
+{
+    for (uint8_t i = s_n; i-- > 0;)
+    {
+        if (!s_ent[i].act && (int8_t)i != s_busy)
+        {
+            reject(&s_pool[s_ent[i].off], CMDQ_SHED);
+            remove_entry(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* [s, e) equals the flash string, ignoring surrounding blanks */
+static bool
+field_is(const char *s, const char *e, const char *str_P)
+{
+    while (s < e && is_space(*s)) { s++; }
+    while (e > s && is_space(e[-1])) { e--; }
+    size_t n = (size_t)(e - s);
+    return n == strlen_P(str_P) && strncmp_P(s, str_P, n) == 0;
+}
+
+static bool
+is_actuation(const char *s, const char *e)
+{
+    for (const char *v = s_act_verbs; pgm_read_byte(v); v += strlen_P(v) + 1)
+    {
+        if (field_is(s, e, v))
+        { return true; }
+    }
+    return false;
+}
+
+static uint16_t
+hash_from(const char *s)
+{
+    uint16_t h = 5381;
+    for (; *s && !is_space(*s); s++)
+    { h = (uint16_t)((h << 5) + h + (uint8_t)*s); }
+    return h;
+}
+
+static cmdq_bucket_t *
+bucket_for(uint16_t src)
+{
+    uint32_t       now  = timer_now();
+    cmdq_bucket_t *take = NULL;
+
+    for (uint8_t k = 0; k < CMDQ_SOURCES; k++)
+    {
+        cmdq_bucket_t *b = &s_bkt[k];
+        if (!b->used)
+        {
+            if (!take || take->used)
+            { take = b; }
+            continue;
+        }
+
+        uint32_t dt = now - b->t;
+        if (dt > CMDQ_FULL) { dt = CMDQ_FULL; }  /* rate >= 1/s */
+        uint32_t m = b->milli + dt * CMDQ_RATE;
+        b->milli = m > CMDQ_FULL ? CMDQ_FULL : (uint16_t)m;
+        b->t     = now;
+
+        if (b->src == src)
+        { return b; }
+        if (!take || (take->used && b->milli > take->milli))
+        { take = b; }
+    }
+
+    /* a new sender gets a free bucket, full, or else the fullest one
+       at the level it has, at most CMDQ_RESERVE tokens: cycling
+       through FROM names buys no tokens the buckets did not refill */
+    if (!take->used)
+    {
+        take->used  = true;
+        take->milli = CMDQ_FULL;
+        take->t     = now;
+    }
+    else if (take->milli > CMDQ_RESERVE * 1000U)
+    { take->milli = CMDQ_RESERVE * 1000U; }
+    take->src = src;
+    return take;
+}
+
+/* the line in framing is complete: TO:[#seq:]VERB:...:FROM */
+static cmdq_res_t
+admit(uint16_t len)
+{
+    char       *line = &s_pool[s_used];
+    char       *c1   = strchr(line, ':');
+    bool        act  = false;
+    const char *from = "";
+
+    if (c1)
+    {
+        if (!field_is(line, c1, PSTR(NODE_ADDR)) && !field_is(line, c1, PSTR("ALL")))
+        { return CMDQ_FOREIGN; }
+
+        char *verb = c1 + 1;
+        while (is_space(*verb)) { verb++; }
+        if (*verb == '#' && strchr(verb, ':'))
+        { verb = strchr(verb, ':') + 1; }
+        char *ve = strchr(verb, ':');
+        act  = is_actuation(verb, ve ? ve : verb + strlen(verb));
+        from = strrchr(line, ':') + 1;
+        while (is_space(*from)) { from++; }
+    }
+    /* no ':' at all is left queued, handle_cmd reports the format error */
+
+    cmdq_bucket_t *b = bucket_for(hash_from(from));
+    if (b->milli < (act ? 1000U : (1U + CMDQ_RESERVE) * 1000U))
+    {
+        reject(line, CMDQ_THROTTLED);
+        return CMDQ_THROTTLED;
+    }
+    if (s_n == CMDQ_DEPTH && !(act && evict_query()))
+    {
+        reject(line, CMDQ_SHED);
+        return CMDQ_SHED;
+    }
+    b->milli -= 1000;
+
+    cmdq_ent_t *e = &s_ent[s_n++];
+    e->off = s_used;
+    e->len = len;
+    e->src = b->src;
+    e->t   = (uint16_t)timer_now();
+    e->act = act;
+    s_used += len;
+    if (s_n > s_st.peak) { s_st.peak = s_n; }
+    return CMDQ_QUEUED;
+}
+
+cmdq_res_t
+cmdq_feed(uint8_t b)
+{
+    if (b == '\n')
+    {
+        s_pool[s_used + s_tail++] = '\0'; /* moves along if admit() evicts */
+        cmdq_res_t r = admit(s_tail);
+        s_tail = 0;
+        return r;
+    }
+    if (s_used + s_tail + 2 > CMDQ_POOL)
+    {
+        s_tail = 0;               /* only with an empty queue, see */
+        return CMDQ_OVERFLOW;     /* cmdq_room(): longer than the pool */
+    }
+    s_pool[s_used + s_tail++] = (char)b;
+    return CMDQ_MORE;
+}
+
+void
+cmdq_init(cmdq_reject_fn fn)
+{
+    s_reject = fn;
+}
+
+/* room for one more byte and the NUL, pushing out queries if need be;
+   with only actuations queued the caller leaves RX bytes in the ring
+   until dispatch frees some */
+bool
+cmdq_room(void)
+{
+    while (s_used + s_tail + 2 > CMDQ_POOL)
+    {
+        if (!s_n)
+        { return true; } /* cmdq_feed() reports the overflow */
+        if (!evict_query())
+        { return false; }
+    }
+    return true;
+}
+
+bool
+cmdq_next(char **line)
+{
+    if (!s_n)
+    { return false; }
+
+    /* oldest actuation not queued behind a query from its own sender,
+       so one sender's commands still run in the order it sent them */
+    uint8_t pick = 0;
+    for (uint8_t i = 0; i < s_n; i++)
+    {
+        if (!s_ent[i].act)
+        { continue; }
+        uint8_t j = 0;
+        while (j < i && (s_ent[j].act || s_ent[j].src != s_ent[i].src))
+        { j++; }
+        if (j == i)
+        {
+            pick = i;
+            break;
+        }
+    }
+
+    s_busy = (int8_t)pick;
+    *line  = &s_pool[s_ent[pick].off];
+    return true;
+}
+
+void
+cmdq_done(void)
+{
+    if (s_busy < 0)
+    { return; }
+    remove_entry((uint8_t)s_busy);
+    s_busy = -1;
+}
+
+uint16_t
+cmdq_age_ms(void)
+{
+    if (s_busy < 0)
+    { return 0; }
+    return (uint16_t)((uint16_t)timer_now() - s_ent[s_busy].t);
+}
+
+uint8_t
+cmdq_len(void)
+{
+    return s_n;
+}
+
+void
+cmdq_stats(cmdq_stats_t *out)
+{
+    *out     = s_st;
+    out->len = s_n;
+}
@@ -1,20 +1,104 @@
 #include "gpio.h"
 #include "config.h"
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include <stdbool.h>
+
+#if LED_CHANNELS < 1 || LED_CHANNELS > 4
+#error "LED_CHANNELS must be 1..4"
+#endif
+#if PWM_BITS < 8 || PWM_BITS > 16
+#error "PWM_BITS must be 8..16"
+#endif
 
 static uint8_t s_lamp_on = 0;
 
+#if FEAT_LED
+#define PWM_TOP        ((uint16_t)((1UL << PWM_BITS) - 1))
+#define PWM_FRAC_BITS  (16 - PWM_BITS)
+#define PWM_FRAC_MASK  ((uint16_t)((1UL << PWM_FRAC_BITS) - 1))
+#define PWM_T1_CH      (LED_CHANNELS > 1 ? 2 : 1)
+
+/* CIE 1931 lightness: L* = 100 * level / 255 -> relative luminance,
+   scaled to 16 bits.  Linear below L* 8, so level 1 is still lit. */
+static const uint16_t s_gamma[256] PROGMEM =
+{
+        0,    28,    57,    85,   114,   142,   171,   199,
+      228,   256,   285,   313,   341,   370,   398,   427,
+      455,   484,   512,   541,   569,   598,   627,   658,
+      689,   721,   755,   789,   825,   861,   899,   937,
+      977,  1018,  1060,  1103,  1147,  1192,  1239,  1287,
+     1336,  1386,  1437,  1490,  1544,  1599,  1656,  1714,
+     1773,  1834,  1896,  1959,  2024,  2090,  2157,  2226,
+     2297,  2369,  2442,  2517,  2593,  2671,  2751,  2832,
+     2914,  2999,  3085,  3172,  3261,  3352,  3444,  3538,
+     3634,  3732,  3831,  3932,  4035,  4139,  4245,  4354,
+     4464,  4575,  4689,  4804,  4922,  5041,  5162,  5285,
+     5410,  5537,  5666,  5797,  5930,  6065,  6202,  6341,
+     6482,  6626,  6771,  6918,  7068,  7220,  7373,  7529,
+     7687,  7848,  8010,  8175,  8342,  8512,  8683,  8857,
+     9033,  9212,  9393,  9576,  9762,  9949, 10140, 10333,
+    10528, 10725, 10926, 11128, 11333, 11541, 11751, 11963,
+    12179, 12396, 12617, 12840, 13065, 13293, 13524, 13757,
+    13993, 14232, 14474, 14718, 14965, 15215, 15467, 15722,
+    15980, 16241, 16505, 16771, 17041, 17313, 17588, 17866,
+    18147, 18431, 18717, 19007, 19300, 19596, 19894, 20196,
+    20501, 20809, 21119, 21433, 21750, 22071, 22394, 22720,
+    23050, 23383, 23719, 24058, 24400, 24746, 25095, 25447,
+    25802, 26161, 26523, 26888, 27257, 27629, 28004, 28383,
+    28765, 29151, 29540, 29932, 30328, 30728, 31131, 31537,
+    31947, 32360, 32777, 33198, 33622, 34050, 34481, 34916,
+    35355, 35797, 36243, 36693, 37146, 37603, 38064, 38529,
+    38997, 39469, 39945, 40425, 40908, 41396, 41887, 42382,
+    42881, 43384, 43891, 44401, 44916, 45435, 45957, 46484,
+    47015, 47549, 48088, 48631, 49178, 49728, 50283, 50843,
+    51406, 51973, 52545, 53120, 53700, 54284, 54873, 55465,
+    56062, 56663, 57269, 57878, 58492, 59111, 59733, 60360,
+    60992, 61627, 62268, 62912, 63561, 64215, 64873, 65535,
+};
+
+#if PWM_DITHER && PWM_FRAC_BITS
+static volatile uint16_t s_duty[PWM_T1_CH];  /* 16-bit target per channel */
+static uint16_t          s_err[PWM_T1_CH];   /* sigma-delta residue */
+#endif
+#endif /* FEAT_LED */
+
 void
 gpio_init(void)
 {
+#if FEAT_LED
     LED_DDR  |= LED_PIN_BM;   /* PB1 output (Timer1 controls pin) */
+#endif
     BUZZ_DDR |= BUZZ_PIN_BM;  /* PD6 output */
     LAMP_DDR |= LAMP_PIN_BM;  /* PD4 output */
 
-    /* Timer1 Fast PWM 8-bit on OC1A (PB1) */
-    TCCR1A = _BV(COM1A1) | _BV(WGM10);
-    TCCR1B = _BV(WGM12)  | _BV(CS11); /* presc=8 */
+#if FEAT_LED
+    /* Timer1 Fast PWM, TOP = ICR1 (mode 14), on OC1A (PB1) [+ OC1B (PB2)] */
+    ICR1   = PWM_TOP;
+    TCCR1A = _BV(COM1A1) | _BV(WGM11);
+    TCCR1B = _BV(WGM13)  | _BV(WGM12) | _BV(CS10); /* presc=1 */
     OCR1A  = 0;
+#if LED_CHANNELS > 1
+    LED1_DDR |= LED1_PIN_BM;
+    TCCR1A   |= _BV(COM1B1);
+    OCR1B     = 0;
+#endif
+
+#if LED_CHANNELS > 2
+    /* Timer2 Fast PWM on OC2A (PB3) [+ OC2B (PD3)], same presc=8 */
+    LED2_DDR |= LED2_PIN_BM;
+    TCCR2A    = _BV(COM2A1) | _BV(WGM21) | _BV(WGM20);
+    TCCR2B    = _BV(CS21);
+    OCR2A     = 0;
+#endif
+#if LED_CHANNELS > 3
+    LED3_DDR |= LED3_PIN_BM;
+    TCCR2A   |= _BV(COM2B1);
+    OCR2B     = 0;
+#endif
+#endif /* FEAT_LED */
 
     /* Defaults */
     BUZZ_PORT &= (uint8_t)~BUZZ_PIN_BM;
@@ -54,8 +138,89 @@ buzzer_set(uint8_t on)
     }
 }
 
+#if FEAT_LED
+uint16_t
+pwm_gamma(uint8_t level)
+{
+    return pgm_read_word(&s_gamma[level]);
+}
+
+#if PWM_DITHER && PWM_FRAC_BITS
+/* At TOP; the OCR1x written here is latched at the next BOTTOM, so each
+   period gets the integer duty plus the carry of the accumulated
+   fraction.  Runs only while some duty is below PWM_DITHER_MAX with
+   fraction bits. */
+ISR(TIMER1_OVF_vect)
+{
+    for (uint8_t ch = 0; ch < PWM_T1_CH; ch++)
+    {
+        uint16_t d   = s_duty[ch];
+        uint16_t acc = s_err[ch] + (d & PWM_FRAC_MASK);
+        uint16_t out = (d >> PWM_FRAC_BITS) + (acc >> PWM_FRAC_BITS);
+        s_err[ch]    = acc & PWM_FRAC_MASK;
+        if (out > PWM_TOP) { out = PWM_TOP; }
+
+        if (ch == 0) { OCR1A = out; }
+#if LED_CHANNELS > 1
+        else         { OCR1B = out; }
+#endif
+    }
+}
+#endif
+
 void
-led_pwm_set(uint8_t duty_0_255)
+pwm_set(uint8_t ch, uint8_t level)
 {
-    OCR1A = duty_0_255; /* 8-bit PWM */
+    uint16_t d = pwm_gamma(level);
+
+    /* Timer1 is PWM_BITS wide, Timer2 8-bit; an OCR write takes effect
+       at the next BOTTOM */
+    switch (ch)
+    {
+#if PWM_DITHER && PWM_FRAC_BITS
+        case 0:
+#if LED_CHANNELS > 1
+        case 1:
+#endif
+        {
+            /* TOP is already 100 %, no need to dither above it */
+            if (d > (uint16_t)(PWM_TOP << PWM_FRAC_BITS))
+            { d = (uint16_t)(PWM_TOP << PWM_FRAC_BITS); }
+            /* one count is invisible up here: round, keep the ISR off */
+            if ((d >> PWM_FRAC_BITS) >= PWM_DITHER_MAX)
+            { d = (uint16_t)((d + (PWM_FRAC_MASK >> 1) + 1) & ~PWM_FRAC_MASK); }
+
+            uint8_t sreg = SREG;
+            cli();
+            s_duty[ch] = d;
+            bool frac = false;
+            for (uint8_t i = 0; i < PWM_T1_CH; i++)
+            { frac |= (s_duty[i] & PWM_FRAC_MASK) != 0; }
+            if (frac)
+            { TIMSK1 |= _BV(TOIE1); }
+            else
+            {
+                TIMSK1 &= (uint8_t)~_BV(TOIE1);
+                OCR1A   = s_duty[0] >> PWM_FRAC_BITS;
+#if LED_CHANNELS > 1
+                OCR1B   = s_duty[1] >> PWM_FRAC_BITS;
+#endif
+            }
+            SREG = sreg;
+        } break;
+#else
+        case 0: OCR1A = d >> (16 - PWM_BITS); break;
+#if LED_CHANNELS > 1
+        case 1: OCR1B = d >> (16 - PWM_BITS); break;
+#endif
+#endif
+#if LED_CHANNELS > 2
+        case 2: OCR2A = (uint8_t)(d >> 8); break;
+#endif
+#if LED_CHANNELS > 3
+        case 3: OCR2B = (uint8_t)(d >> 8); break;
+#endif
+        default: break;
+    }
 }
+#endif /* FEAT_LED */
@@ -1,82 +1,304 @@
 #include "led.h"
 #include "gpio.h"
 #include "timer.h"
+#include "sched.h"
+#include "ws2812.h"
+#include "ambient.h"
+#include "alarm.h"
+#include "config.h"
 
-static led_state_t s_led = { .mode = LED_MODE_BLINK, .brightness = 0 };
-static int16_t     s_dir = 1; /* for FADE ramp */
-static bool        s_blink = true;
-static Timer       s_led_tim;
+#if FEAT_LED
+
+static led_state_t s_led[LED_CHANNELS];
+static int8_t      s_dir[LED_CHANNELS];   /* for FADE ramp */
+static bool        s_blink[LED_CHANNELS];
+static Timer       s_led_tim;             /* shared effects frame */
+static uint32_t    s_tick_due  = 0;       /* ms the task asked to wake */
+static uint32_t    s_tick_gap  = 0;
+
+SCHED_TASK(s_effects_task, effects_task, "EFFECTS", SCHED_PRIO_EFFECTS)
+
+/* timed brightness transitions, s_ramp_ms == 0 when idle */
+static uint8_t     s_ramp_from[LED_CHANNELS];
+static uint8_t     s_ramp_to[LED_CHANNELS];
+static uint16_t    s_ramp_ms[LED_CHANNELS];
+static uint32_t    s_ramp_t0[LED_CHANNELS];
+static uint32_t    s_ramp_last = 0;
+
+#if WS2812_ENABLE
+static uint8_t     s_strip_lvl   = 0;     /* last channel 0 output */
+static bool        s_strip_stale = true;
+static uint8_t     s_strip_phase = 0;     /* FADE wave position */
+#endif
+
+/* all duty writes go through here so the strip can mirror channel 0 */
+static void
+led_out(uint8_t ch, uint8_t duty)
+{
+    pwm_set(ch, duty);
+#if WS2812_ENABLE
+    if (ch == 0)
+    {
+        s_strip_lvl   = duty;
+        s_strip_stale = true;
+        sched_signal(&s_effects_task);
+    }
+#endif
+}
+
+#if WS2812_ENABLE
+/* SOLID/BLINK light the whole strip at channel 0's level, FADE runs a
+   triangle wave along it; only changed pixels mark the frame dirty.
+   Levels go through the PWM lightness table so both outputs match. */
+static void
+strip_render(void)
+{
+    const led_state_t *led = &s_led[0];
+
+    if (!led->state || led->mode != LED_MODE_FADE)
+    {
+        uint8_t g = (uint8_t)(pwm_gamma(s_strip_lvl) >> 8);
+        ws2812_fill(g, g, g);
+        return;
+    }
+
+    for (uint16_t i = 0; i < WS2812_PIXELS; i++)
+    {
+        uint8_t  x = (uint8_t)(s_strip_phase + (i * 256U) / WS2812_PIXELS);
+        uint16_t v = x < 128 ? x * 2U : (255U - x) * 2U;
+        v = (v * led->brightness + 255U) >> 8;
+        uint8_t g = (uint8_t)(pwm_gamma((uint8_t)v) >> 8);
+        ws2812_set(i, g, g, g);
+    }
+}
+#endif
 
 void
 effects_init(void)
 {
-    s_led.mode       = LED_MODE_BLINK;
-    s_led.state      = 1;
-    s_led.brightness = 0;
-    s_led.actual_bright = 0;
-    led_pwm_set(0);
-    timer_set(&s_led_tim, 100, true);
+    for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+    {
+        s_led[ch].mode          = LED_MODE_BLINK;
+        s_led[ch].state         = 1;
+        s_led[ch].brightness    = 0;
+        s_led[ch].actual_bright = 0;
+        s_led[ch].auto_bright   = 0;
+        s_dir[ch]   = 1;
+        s_blink[ch] = true;
+        led_out(ch, 0);
+    }
+#if WS2812_ENABLE
+    ws2812_init();
+#endif
+    timer_set(&s_led_tim, EFFECTS_FRAME_MS, true);
     timer_start(&s_led_tim);
+    s_tick_due = timer_now();
 }
 
 void
-effects_set_mode(led_mode_t mode)
+effects_set_mode(uint8_t ch, led_mode_t mode)
 {
-    s_led.mode = mode;
-    if (s_led.mode == LED_MODE_SOLID)
-    { led_pwm_set(s_led.brightness); }
+    if (ch >= LED_CHANNELS)
+    { return; }
+
+    s_led[ch].mode = mode;
+    if (s_led[ch].mode == LED_MODE_SOLID)
+    { led_out(ch, s_led[ch].brightness); }
 }
 
 void
-effects_set_state(uint8_t state)
+effects_set_state(uint8_t ch, uint8_t state)
 {
-    s_led.state = state;
+    if (ch >= LED_CHANNELS)
+    { return; }
+
+    s_led[ch].state = state;
     if (state)
-    { led_pwm_set(s_led.brightness); }
+    { led_out(ch, s_led[ch].brightness); }
     else
-    { led_pwm_set(0); }
+    { led_out(ch, 0); }
 }
 
 void
-effects_set_brightness(uint8_t b)
+effects_set_brightness(uint8_t ch, uint8_t b)
 {
-    s_led.brightness = s_led.actual_bright = b;
-    if (s_led.mode == LED_MODE_SOLID)
-    { led_pwm_set(b); }
+    if (ch >= LED_CHANNELS)
+    { return; }
+
+    s_ramp_ms[ch] = 0;
+    s_led[ch].brightness = s_led[ch].actual_bright = b;
+    if (s_led[ch].mode == LED_MODE_SOLID)
+    { led_out(ch, b); }
+}
+
+void
+effects_set_auto(uint8_t ch, uint8_t on)
+{
+#if AMBIENT_ENABLE
+    if (ch < LED_CHANNELS)
+    { s_led[ch].auto_bright = on ? 1 : 0; }
+#else
+    (void)ch; (void)on;
+#endif
 }
 
 led_state_t
-effects_get(void)
+effects_get(uint8_t ch)
 {
-    return s_led;
+    return s_led[ch < LED_CHANNELS ? ch : 0];
 }
 
 void
-effects_tick_1ms(void)
+effects_fade_to(uint8_t ch, uint8_t b, uint16_t ms)
 {
-    if (!s_led.state)
+    if (ch >= LED_CHANNELS)
     { return; }
+    if (!ms)
+    { effects_set_brightness(ch, b); return; }
+
+    s_ramp_from[ch] = s_led[ch].brightness;
+    s_ramp_to[ch]   = b;
+    s_ramp_ms[ch]   = ms;
+    s_ramp_t0[ch]   = timer_now();
+    sched_signal(&s_effects_task);
+}
+
+static void
+ramp_step(uint8_t ch, uint32_t now)
+{
+    uint32_t el = now - s_ramp_t0[ch];
+    uint8_t  b  = s_ramp_to[ch];
+    if (el < s_ramp_ms[ch])
+    {
+        int16_t span = (int16_t)s_ramp_to[ch] - (int16_t)s_ramp_from[ch];
+        b = (uint8_t)(s_ramp_from[ch] + (int32_t)span * (int32_t)el / s_ramp_ms[ch]);
+    }
+    else
+    { s_ramp_ms[ch] = 0; }
 
-    if (!timer_timeout(&s_led_tim))
+    /* FADE keeps its own ramp position, only its ceiling moves */
+    led_state_t *led = &s_led[ch];
+    if (b == led->brightness)
     { return; }
+    led->brightness = b;
+    if (led->mode == LED_MODE_SOLID)
+    {
+        led->actual_bright = b;
+        if (led->state)
+        { led_out(ch, b); }
+    }
+}
+
+uint32_t
+effects_tick_gap_max(void)
+{
+    uint32_t g = s_tick_gap;
+    s_tick_gap = 0;
+    return g;
+}
+
+static void
+effects_frame(uint8_t ch)
+{
+    led_state_t *led = &s_led[ch];
 
-    switch (s_led.mode)
+    switch (led->mode)
     {
         case LED_MODE_SOLID:
             /* steady brightness already applied */
             break;
         case LED_MODE_FADE:
         {
-            int16_t v = (int16_t)s_led.actual_bright + s_dir * 5;
-            if (v >= 255) { v = 255; s_dir = -1; }
-            if (v <= 0)   { v = 0;   s_dir =  1; }
-            s_led.actual_bright = (uint8_t)v;
-            led_pwm_set(s_led.actual_bright);
+            int16_t v = (int16_t)led->actual_bright + s_dir[ch] * 5;
+            if (v >= 255) { v = 255; s_dir[ch] = -1; }
+            if (v <= 0)   { v = 0;   s_dir[ch] =  1; }
+            led->actual_bright = (uint8_t)v;
+            led_out(ch, led->actual_bright);
         } break;
         case LED_MODE_BLINK:
         {
-            led_pwm_set(s_blink * s_led.brightness);
-            s_blink = !s_blink; 
+            led_out(ch, s_blink[ch] * led->brightness);
+            s_blink[ch] = !s_blink[ch];
         } break;
     }
 }
+
+static void
+effects_tick(void)
+{
+    /* how late a timed wake-up ran; signalled early runs do not count */
+    uint32_t now = timer_now_us();
+    uint32_t due = s_tick_due * 1000UL;
+    if ((int32_t)(now - due) > (int32_t)s_tick_gap)
+    { s_tick_gap = now - due; }
+
+    uint32_t ms = timer_now();
+    if (ms != s_ramp_last)
+    {
+        s_ramp_last = ms;
+        for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+        {
+            if (s_ramp_ms[ch])
+            { ramp_step(ch, ms); }
+        }
+    }
+
+    if (timer_timeout(&s_led_tim))
+    {
+        for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+        {
+#if AMBIENT_ENABLE
+            if (s_led[ch].auto_bright)
+            {
+                uint8_t b = ambient_brightness(s_led[ch].brightness);
+                if (b != s_led[ch].brightness)
+                { effects_set_brightness(ch, b); }
+            }
+#endif
+            if (s_led[ch].state)
+            { effects_frame(ch); }
+        }
+#if WS2812_ENABLE
+        s_strip_phase += 4;
+#endif
+#if FEAT_ALARM
+        alarm_frame();
+#endif
+    }
+
+#if WS2812_ENABLE
+    if (s_strip_stale)
+    {
+        strip_render();
+        s_strip_stale = false;
+    }
+    ws2812_show(); /* no-op unless a pixel changed */
+#endif
+}
+
+/* next ms with work: every ms while a ramp runs, else the next frame */
+static uint32_t
+effects_next_due(void)
+{
+    for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+    {
+        if (s_ramp_ms[ch])
+        { return timer_now() + 1; }
+    }
+    return timer_deadline(&s_led_tim);
+}
+
+static char
+effects_task(sched_task_t *t)
+{
+    PT_BEGIN(&t->pt);
+    for (;;)
+    {
+        effects_tick();
+        s_tick_due = effects_next_due();
+        SCHED_WAIT_UNTIL(t, s_tick_due, SCHED_EV_SIGNAL);
+    }
+    PT_END(&t->pt);
+}
+
+#endif /* FEAT_LED */
@@ -0,0 +1,139 @@
+#include "loopstat.h"
+#include "timer.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/wdt.h>
+
+#include <stddef.h>
+
+/* ~0.5 s to the interrupt, another ~0.5 s to the reset */
+#define LOOPSTAT_WDT_TIMEOUT  (_BV(WDP2) | _BV(WDP0))
+#define LOOPSTAT_MAGIC        0xA5
+
+static uint16_t         s_hist[LOOPSTAT_SLOTS][LOOPSTAT_BUCKETS];
+static loopstat_task_t  s_task[LOOPSTAT_SLOTS];
+static uint16_t         s_busy_us[LOOPSTAT_SLOTS];  /* below one busy_ms */
+static volatile uint8_t s_stage = LOOPSTAT_STALL_SCHED; /* task now running */
+static uint8_t          s_stall = LOOPSTAT_STALL_NONE;
+
+/* survive the watchdog reset */
+static uint8_t s_wdt_stage __attribute__((section(".noinit")));
+static uint8_t s_wdt_magic __attribute__((section(".noinit")));
+static uint8_t s_mcusr     __attribute__((section(".noinit")));
+
+/* The watchdog stays enabled across its own reset, so clear it before
+   main() (and long init code) gets a chance to be reset again. */
+void loopstat_early(void) __attribute__((naked, used, section(".init3")));
+
+void
+loopstat_early(void)
+{
+    s_mcusr = MCUSR;
+    MCUSR   = 0;
+    wdt_disable();
+}
+
+ISR(WDT_vect)
+{
+    /* hardware cleared WDIE: the next timeout resets us */
+    s_wdt_stage = s_stage;
+    s_wdt_magic = LOOPSTAT_MAGIC;
+}
+
+void
+loopstat_init(void)
+{
+    if ((s_mcusr & _BV(WDRF)) && s_wdt_magic == LOOPSTAT_MAGIC)
+    { s_stall = s_wdt_stage; }
+    s_wdt_magic = 0;
+
+    uint8_t sreg = SREG;
+    cli();
+    wdt_reset();
+    WDTCSR |= _BV(WDCE) | _BV(WDE);
+    WDTCSR  = _BV(WDIE) | _BV(WDE) | LOOPSTAT_WDT_TIMEOUT;
+    SREG = sreg;
+}
+
+static uint8_t
+bucket_of(uint32_t us)
+{
+    uint8_t b = 0;
+    us >>= 3;
+    while (us && b < LOOPSTAT_BUCKETS - 1)
+    {
+        us >>= 1;
+        b++;
+    }
+    return b;
+}
+
+void
+loopstat_enter(uint8_t id)
+{
+    s_stage = id;
+}
+
+uint32_t
+loopstat_account(uint8_t id, uint32_t t_start)
+{
+    uint32_t now = timer_now_us();
+    uint32_t dt  = now - t_start;
+
+    s_stage = LOOPSTAT_STALL_SCHED;
+    if (id >= LOOPSTAT_SLOTS)
+    { return now; }
+
+    uint16_t *c = &s_hist[id][bucket_of(dt)];
+    if (*c != UINT16_MAX) { (*c)++; }
+
+    loopstat_task_t *t = &s_task[id];
+    t->runs++;
+    if (dt > t->max_us) { t->max_us = dt; }
+
+    uint32_t us = s_busy_us[id] + dt;
+    if (us >= 1000)
+    {
+        t->busy_ms += us / 1000;
+        us %= 1000;
+    }
+    s_busy_us[id] = (uint16_t)us;
+
+    return now;
+}
+
+void
+loopstat_pass(void)
+{
+    /* feed the dog, re-arm the interrupt stage */
+    wdt_reset();
+    WDTCSR |= _BV(WDIE);
+}
+
+const uint16_t *
+loopstat_hist(uint8_t id)
+{
+    return id < LOOPSTAT_SLOTS ? s_hist[id] : NULL;
+}
+
+bool
+loopstat_get(uint8_t id, loopstat_task_t *out)
+{
+    if (id >= LOOPSTAT_SLOTS)
+    { return false; }
+    *out = s_task[id];
+    return true;
+}
+
+uint8_t
+loopstat_reset_flags(void)
+{
+    return s_mcusr;
+}
+
+uint8_t
+loopstat_stall(void)
+{
+    return s_stall;
+}
@@ -5,8 +5,11 @@
 #include "uart.h"
 #include "gpio.h"
 #include "protocol.h"
-#include "led.h"
 #include "alarm.h"
+#include "loopstat.h"
+#include "sched.h"
+#include "boot.h"
+#include "config.h"
 #define TIMER_IMPL
 #include "timer.h"
 
@@ -18,17 +21,20 @@ main(void)
 
     gpio_init();
     timer_init();
+#if FEAT_ALARM
     alarm_init();
+#endif
     uart_init(BAUD);
 
     sei();
+    boot_mark(BOOT_HW);
 
+    /* restore the outputs first; anything the node does not need to
+       take commands is left to the BOOT task */
     proto_init();
+    boot_mark(BOOT_NV);
+    loopstat_init();
 
-    for (;;)
-    {
-        proto_poll();
-        effects_tick_1ms();
-        alarm_loop();
-    }
+    boot_mark(BOOT_SCHED);
+    sched_run(); /* tasks register themselves, see sched.h */
 }
@@ -0,0 +1,83 @@
+#include "mem.h"
+#include "config.h"
+#include <avr/io.h>
+#include <stddef.h>
+
+#if FEAT_DIAG
+
+/* Linker / avr-libc symbols */
+extern uint8_t  __data_start;
+extern uint8_t  _end;
+extern uint8_t  __heap_start;
+extern uint8_t  __stack;
+extern char    *__brkval;
+
+struct freelist
+{
+    size_t           sz;
+    struct freelist *nx;
+};
+extern struct freelist *__flp;
+
+static uint8_t *s_brk_peak;
+
+/* Runs from .init1, before the stack pointer and __zero_reg__ are set up,
+   so it is written in asm and must not touch anything but r24/r25/Z. */
+void mem_paint(void) __attribute__((naked, used, section(".init1")));
+
+void
+mem_paint(void)
+{
+    __asm__ volatile (
+        "    ldi r30, lo8(_end)       \n"
+        "    ldi r31, hi8(_end)       \n"
+        "    ldi r24, %0              \n"
+        "    ldi r25, hi8(__stack)    \n"
+        "    rjmp 2f                  \n"
+        "1:  st  Z+, r24              \n"
+        "2:  cpi r30, lo8(__stack)    \n"
+        "    cpc r31, r25             \n"
+        "    brlo 1b                  \n"
+        "    breq 1b                  \n"
+        :: "i" (MEM_CANARY)
+    );
+}
+
+static uint8_t *
+heap_top(void)
+{
+    return __brkval ? (uint8_t *)__brkval : &__heap_start;
+}
+
+void
+mem_sample(void)
+{
+    uint8_t *top = heap_top();
+    if (top > s_brk_peak)
+    { s_brk_peak = top; }
+}
+
+void
+mem_stats(mem_stats_t *out)
+{
+    mem_sample();
+
+    uint16_t flp = 0;
+    for (struct freelist *f = __flp; f; f = f->nx)
+    { flp += (uint16_t)(f->sz + sizeof(size_t)); }
+
+    /* Walk up from the heap break over untouched canary bytes */
+    uint8_t *p   = s_brk_peak;
+    uint8_t *end = (uint8_t *)(uintptr_t)SP;
+    while (p < end && *p == MEM_CANARY)
+    { p++; }
+
+    out->static_sz  = (uint16_t)(&_end - &__data_start);
+    out->heap_cur   = (uint16_t)(heap_top() - &__heap_start);
+    out->heap_peak  = (uint16_t)(s_brk_peak - &__heap_start);
+    out->heap_free  = flp;
+    out->stack_peak = (uint16_t)(&__stack - p + 1);
+    out->stack_gap  = (uint16_t)(p - s_brk_peak);
+}
+
+#endif /* FEAT_DIAG */
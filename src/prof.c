@@ -0,0 +1,117 @@
+#include "prof.h"
+#include "timer.h"
+
+#if PROF_ENABLE
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <string.h>
+
+static uint16_t          s_hist[PROF_BUCKETS];
+static uint16_t          s_samples = 0;
+static uint16_t          s_out     = 0;
+static uint16_t          s_base    = 0;
+static uint8_t           s_shift   = 8;
+static volatile bool     s_running = false;
+
+static volatile uint16_t s_pc      = 0;      /* set by the sampler ISR */
+static volatile bool     s_pc_new  = false;
+
+/* Naked so the stack layout is known: after the three pushes below the
+   return address sits at SP+4 (high byte) and SP+5 (low byte).  None of
+   the instructions touch SREG.  Only the main context can be hit: ISRs
+   do not nest, so time spent in handlers is not visible. */
+ISR(TIMER0_COMPB_vect, ISR_NAKED)
+{
+#if defined(__AVR__)
+    __asm__ volatile (
+        "push r24               \n\t"
+        "push r30               \n\t"
+        "push r31               \n\t"
+        "in   r30, __SP_L__     \n\t"
+        "in   r31, __SP_H__     \n\t"
+        "ldd  r24, Z+5          \n\t"
+        "sts  %[pc], r24        \n\t"
+        "ldd  r24, Z+4          \n\t"
+        "sts  %[pc]+1, r24      \n\t"
+        "ldi  r24, 1            \n\t"
+        "sts  %[nw], r24        \n\t"
+        "pop  r31               \n\t"
+        "pop  r30               \n\t"
+        "pop  r24               \n\t"
+        "reti                   \n\t"
+        :: [pc] "i" (&s_pc), [nw] "i" (&s_pc_new));
+#endif
+}
+
+void
+prof_tick(void)
+{
+    if (!s_pc_new)
+    { return; }
+    s_pc_new = false;
+
+    if (s_samples == UINT16_MAX)
+    { prof_stop(); return; }
+    s_samples++;
+
+    uint16_t off = (uint16_t)(s_pc - s_base);
+    uint16_t i   = (uint16_t)(off >> s_shift);
+    if (s_pc < s_base || i >= PROF_BUCKETS)
+    { s_out++; return; }
+    s_hist[i]++;
+}
+
+void
+prof_start(uint16_t base, uint8_t shift)
+{
+    uint8_t sreg = SREG;
+    cli();
+    memset(s_hist, 0, sizeof(s_hist));
+    s_samples = 0;
+    s_out     = 0;
+    s_base    = base;
+    s_shift   = shift > 15 ? 15 : shift;
+    s_pc_new  = false;
+    s_running = true;
+
+    OCR0B   = (TIMER0_OCR_FOR_1MS + 1) / 2;  /* mid-tick, away from COMPA */
+    TIFR0   = _BV(OCF0B);
+    TIMSK0 |= _BV(OCIE0B);
+    SREG = sreg;
+}
+
+void
+prof_stop(void)
+{
+    TIMSK0 &= (uint8_t)~_BV(OCIE0B);
+    s_running = false;
+}
+
+void
+prof_info(prof_info_t *out)
+{
+    uint8_t sreg = SREG;
+    cli();
+    out->samples = s_samples;
+    out->out     = s_out;
+    out->base    = s_base;
+    out->shift   = s_shift;
+    out->running = s_running;
+    SREG = sreg;
+}
+
+uint16_t
+prof_bucket(uint8_t i)
+{
+    if (i >= PROF_BUCKETS)
+    { return 0; }
+
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t v = s_hist[i];
+    SREG = sreg;
+    return v;
+}
+
+#endif /* PROF_ENABLE */
@@ -5,20 +5,107 @@
 #include "led.h"
 #include "alarm.h"
 #include "storage.h"
+#include "state.h"
+#include "mem.h"
+#include "loopstat.h"
+#include "sched.h"
+#include "boot.h"
+#include "cmdq.h"
+#include "trace.h"
+#include "ws2812.h"
+#include "ambient.h"
+#include "prof.h"
 #include "config.h"
 #include "util.h"
 
+#include <avr/pgmspace.h>
+
+#include <ctype.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 static app_state_t s_state = APP_UNREG;
 
-static char        s_rxline[RX_LINE_MAX];
-static uint16_t    s_rxlen = 0;
-
 static nv_state_t  s_nv;
 
+/* Registration handshake: UNREG -(REG sent)-> WAIT -(REG:ACK)-> READY.
+ * A missed ACK backs off exponentially with equal jitter; never blocks. */
+static Timer       s_reg_tim;
+static uint8_t     s_reg_tries = 0;   /* REGs sent since last UNREG entry */
+static uint32_t    s_reg_t0    = 0;   /* when we became unregistered */
+static uint32_t    s_reg_ms    = 0;   /* time-to-registered of last success */
+
+SCHED_TASK(s_proto_task, proto_task, "PROTO", SCHED_PRIO_PROTO)
+
+/* Optional request tag "#<seq>" (first payload token), echoed as the first
+ * token of every reply sent while that request is handled. */
+static bool        s_seq_on    = false;
+static uint16_t    s_seq       = 0;
+
+#if FEAT_TRACE
+/* Flight recorder names: TV_* / TN_* ids are 1-based indexes into these
+   NUL-separated lists, keep both in the same order */
+static const char  s_verb_ids[]  PROGMEM = "PING\0REG\0ON\0OFF\0TOGGLE\0SET\0GET\0SAVE\0LOAD\0";
+static const char  s_noun_ids[]  PROGMEM = "LAMP\0LED\0BUZZ\0CFG\0ALL\0SINCE\0REG\0MEM\0"
+                                           "RX\0LAT\0LOOP\0UPTIME\0TRACE\0ACK\0REQ\0STRIP\0AMBIENT\0PRESET\0PROF\0TASK\0BOOT\0QUEUE\0";
+static const char  s_event_ids[] PROGMEM = "BOOT\0RXOVF\0LINEOVF\0FORMAT\0";
+#endif
+
+#define TRACE_NOT_OURS 0xFF
+
+/* longest ERR:QUEUE reply, see proto_reject */
+#define PROTO_REJECT_MAX (PROTO_ADDR_MAX + sizeof(":#65535:ERR:QUEUE:RATE:" NODE_ADDR "\n") - 1)
+#define TRACE_PAGE     4
+
+/* a host's full pipelining window must fit the command queue */
+_Static_assert(PROTO_PIPELINE_WINDOW <= CMDQ_DEPTH, "PROTO_PIPELINE_WINDOW exceeds CMDQ_DEPTH");
+
+/* every reply must fit an RS-485 slot; GET:ALL is checked in send_state */
+_Static_assert(PROTO_PAYLOAD_MAX >= 128 - 1, "128-byte reply buffers exceed PROTO_PAYLOAD_MAX");
+#if RS485_ENABLE
+_Static_assert(RS485_SLOT_MS * (uint32_t)BAUD >= PROTO_REPLY_MAX * 10000UL,
+               "RS485_SLOT_MS cannot carry PROTO_REPLY_MAX bytes at BAUD");
+#endif
+
+#if FEAT_STATE
+#define CFG_STR_(x)    #x
+#define CFG_STR(x)     CFG_STR_(x)
+
+/* Build configuration closing GET:ALL, sent straight from flash */
+static const char  s_all_cfg[]   PROGMEM = ",FW=" FW_VERSION ",PROFILE=" PROFILE_NAME
+                                           ",ADDR=" NODE_ADDR
+#if FEAT_LED
+                                           ",PWM=" CFG_STR(PWM_BITS) ",CH=" CFG_STR(LED_CHANNELS)
+#endif
+                                           ",BAUD=" CFG_STR(BAUD);
+#endif
+
+static uint8_t     s_tr_verb   = TRACE_NOT_OURS;
+static uint8_t     s_tr_noun   = 0;
+static uint8_t     s_tr_res    = TRACE_RES_NONE;
+static uint16_t    s_tr_ovf    = 0;
+
+enum { TV_PING = 1, TV_REG, TV_ON, TV_OFF, TV_TOGGLE, TV_SET, TV_GET, TV_SAVE,
+       TV_LOAD };
+enum { TN_LAMP = 1, TN_LED, TN_BUZZ, TN_CFG, TN_ALL, TN_SINCE, TN_REG, TN_MEM,
+       TN_RX, TN_LAT, TN_LOOP, TN_UPTIME, TN_TRACE, TN_ACK, TN_REQ, TN_STRIP,
+       TN_AMBIENT, TN_PRESET, TN_PROF, TN_TASK, TN_BOOT, TN_QUEUE };
+
+/* dispatch compares verb and noun once per branch anyway; the branch
+   that matches notes the trace id, so no second scan is needed */
+#define IS_VERB(name) tok_is(verb, PSTR(#name), &s_tr_verb, TV_##name)
+#define IS_NOUN(name) tok_is(noun, PSTR(#name), &s_tr_noun, TN_##name)
+
+static bool
+tok_is(const char *tok, const char *name_P, uint8_t *tr_id, uint8_t id)
+{
+    if (strcmp_P(tok, name_P) != 0)
+    { return false; }
+    *tr_id = id;
+    return true;
+}
+
 static void
 trim(char *s)
 {
@@ -27,51 +114,241 @@ trim(char *s)
     while (n && (s[n-1] == ' ' || s[n-1] == '\r' || s[n-1] == '\n')) { s[--n] = '\0'; }
 }
 
+/* Frame: <TO>:<PAYLOAD>:<NODE_ADDR>\n, streamed piecewise with no stack copy */
+static void
+frame_begin(const char *to)
+{
+    uart_write_str(to);
+    uart_write_str_P(PSTR(":"));
+    if (s_tr_res == TRACE_RES_NONE) { s_tr_res = TRACE_RES_OK; }
+    if (s_seq_on)
+    {
+        char tag[6];
+        uart_write_str_P(PSTR("#"));
+        uart_write_str(utoa(s_seq, tag, 10));
+        uart_write_str_P(PSTR(":"));
+    }
+}
+
 static void
-send_line(const char *line)
+frame_begin_P(const char *to_P)
 {
-    uart_write_str(line);
-    uart_write_str("\n");
+    uart_write_str_P(to_P);
+    uart_write_str_P(PSTR(":"));
+}
+
+static void
+frame_end(void)
+{
+    uart_write_str_P(PSTR(":" NODE_ADDR "\n"));
 }
 
 void
 proto_send(const char *to, const char *payload)
 {
-    char buf[96];
-    snprintf(buf, sizeof(buf), "%s:%s:%s", to, payload, "VERTEX");
-    send_line(buf);
+    frame_begin(to);
+    uart_write_str(payload);
+    frame_end();
+}
+
+void
+proto_send_P(const char *to, const char *payload_P)
+{
+    frame_begin(to);
+    uart_write_str_P(payload_P);
+    frame_end();
 }
 
 void
 proto_send_ok(const char *topic, const char *to)
 {
-    char pl[48];
-    snprintf(pl, sizeof(pl), "OK:%s", topic);
-    proto_send(to, pl);
+    frame_begin(to);
+    uart_write_str_P(PSTR("OK:"));
+    uart_write_str(topic);
+    frame_end();
+}
+
+void
+proto_send_ok_P(const char *topic_P, const char *to)
+{
+    frame_begin(to);
+    uart_write_str_P(PSTR("OK:"));
+    uart_write_str_P(topic_P);
+    frame_end();
 }
 
 void
 proto_send_error(const char *topic, const char *reason, const char *to)
 {
-    char pl[64];
-    snprintf(pl, sizeof(pl), "ERR:%s:%s", topic, reason);
-    proto_send(to, pl);
+    frame_begin(to);
+    s_tr_res = TRACE_RES_ERR;
+    uart_write_str_P(PSTR("ERR:"));
+    uart_write_str(topic);
+    uart_write_str_P(PSTR(":"));
+    uart_write_str(reason);
+    frame_end();
+}
+
+void
+proto_send_error_P(const char *topic_P, const char *reason_P, const char *to)
+{
+    frame_begin(to);
+    s_tr_res = TRACE_RES_ERR;
+    uart_write_str_P(PSTR("ERR:"));
+    uart_write_str_P(topic_P);
+    uart_write_str_P(PSTR(":"));
+    uart_write_str_P(reason_P);
+    frame_end();
+}
+
+static void
+broadcast_P(const char *payload_P)
+{
+    frame_begin_P(PSTR("ALL"));
+    uart_write_str_P(payload_P);
+    frame_end();
+}
+
+static void
+broadcast_error_P(const char *topic_P, const char *reason_P)
+{
+    frame_begin_P(PSTR("ALL"));
+    uart_write_str_P(PSTR("ERR:"));
+    uart_write_str_P(topic_P);
+    uart_write_str_P(PSTR(":"));
+    uart_write_str_P(reason_P);
+    frame_end();
+}
+
+static void
+reg_restart(uint16_t max_delay)
+{
+    s_state     = APP_UNREG;
+    s_reg_tries = 0;
+    s_reg_t0    = timer_now();
+    timer_set(&s_reg_tim, prng_next() % (max_delay + 1U), false);
+    timer_start(&s_reg_tim);
+}
+
+static void
+reg_ack(void)
+{
+    if (s_state == APP_READY)
+    { return; }
+
+    timer_stop(&s_reg_tim);
+    s_reg_ms = timer_now() - s_reg_t0;
+    s_state  = APP_READY;
+    boot_mark(BOOT_REG);
+}
+
+static void
+reg_tick(void)
+{
+    if (s_state == APP_READY || !timer_timeout(&s_reg_tim))
+    { return; }
+
+    if (s_state == APP_UNREG)
+    {
+        broadcast_P(PSTR("REG:" NODE_ADDR));
+        if (s_reg_tries < UINT8_MAX) { s_reg_tries++; }
+        s_state = APP_WAIT;
+        timer_set(&s_reg_tim, REG_ACK_TIMEOUT_MS, false);
+        timer_start(&s_reg_tim);
+        return;
+    }
+
+    /* APP_WAIT: ACK timed out; backoff = base << (tries-1), capped,
+       then wait a uniformly random point in [backoff/2, backoff] */
+    uint8_t  shift   = (uint8_t)(s_reg_tries - 1);
+    uint32_t backoff = REG_BACKOFF_MAX_MS;
+    if (shift < 8 && (REG_RETRY_PERIOD_MS << shift) < REG_BACKOFF_MAX_MS)
+    { backoff = REG_RETRY_PERIOD_MS << shift; }
+
+    uint32_t half   = backoff / 2;
+    uint32_t jitter = ((uint32_t)prng_next() * (half + 1)) >> 16;
+
+    s_state = APP_UNREG;
+    timer_set(&s_reg_tim, half + jitter, false);
+    timer_start(&s_reg_tim);
+}
+
+/* a throttled or shed line is answered with a tagged ERR:QUEUE:RATE
+   or ERR:QUEUE:FULL so the sender sees a failure, not a timeout; REG
+   is never answered */
+static void
+proto_reject(char *line, cmdq_res_t why)
+{
+    char *pay  = strchr(line, ':');
+    char *from = strrchr(line, ':');
+    if (!pay || from == pay)
+    { return; } /* nobody to answer */
+    *pay++  = '\0';
+    *from++ = '\0';
+    trim(line);
+    trim(from);
+    if (strlen(from) > PROTO_ADDR_MAX || !uart_tx_ready(PROTO_REJECT_MAX))
+    { return; } /* too long for PROTO_REPLY_MAX, or no room to answer
+                   without stalling: the stats still count it */
+
+    char *verb = pay;
+    if (*verb == '#')
+    {
+        s_seq    = (uint16_t)strtoul(verb + 1, &verb, 10);
+        s_seq_on = true;
+        verb     = (*verb == ':') ? verb + 1 : verb;
+    }
+    if (strncmp_P(verb, PSTR("REG"), 3) != 0 || (verb[3] != ':' && verb[3] != '\0'))
+    {
+        if (strcmp_P(line, PSTR("ALL")) == 0
+            && !uart_tx_defer(RS485_GUARD_MS + NODE_SLOT * RS485_SLOT_MS))
+        { s_seq_on = false; return; } /* no hold left, and no slot to spill into */
+        proto_send_error_P(PSTR("QUEUE"),
+                           why == CMDQ_THROTTLED ? PSTR("RATE") : PSTR("FULL"), from);
+    }
+    s_seq_on = false;
+}
+
+static void
+apply_nv(const nv_state_t *nv)
+{
+    lamp_set(nv->lamp_on);
+#if FEAT_LED
+    for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+    {
+        effects_set_mode(ch, nv->led[ch].mode);
+        effects_set_state(ch, nv->led[ch].state);
+        effects_set_brightness(ch, nv->led[ch].brightness);
+        effects_set_auto(ch, nv->led[ch].auto_bright);
+    }
+#endif
 }
 
 void
 proto_init(void)
 {
+    cmdq_init(proto_reject);
     storage_load(&s_nv);
-    lamp_set(s_nv.lamp_on);
+#if FEAT_LED
     effects_init();
-    effects_set_mode(s_nv.led.mode);
-    effects_set_state(s_nv.led.state);
-    effects_set_brightness(s_nv.led.brightness);
+#endif
+    apply_nv(&s_nv);
 
-    s_state = APP_READY;
-    proto_send("ALL", "REG:VERTEX");
+    state_init();
 }
 
+void
+proto_boot(void)
+{
+    trace_init();
+
+    /* power-up SRAM can match across boards; the address never does */
+    uint32_t mix = timer_now();
+    for (const char *p = PSTR(NODE_ADDR); pgm_read_byte(p); p++)
+    { mix = mix * 31U + pgm_read_byte(p); }
+    prng_seed(mix);
+    reg_restart(REG_BOOT_JITTER_MS);
+}
 
 app_state_t
 proto_get_state(void)
@@ -79,263 +356,1033 @@ proto_get_state(void)
     return s_state;
 }
 
+/* name helpers return flash pointers, print them with %S */
+#if FEAT_STATE
+static const char *
+led_mode_name(uint8_t mode)
+{
+    switch (mode)
+    {
+        case LED_MODE_SOLID: return PSTR("SOLID");
+        case LED_MODE_FADE:  return PSTR("FADE");
+        case LED_MODE_BLINK: return PSTR("BLINK");
+        default:             return PSTR("UNK");
+    }
+}
+
+static const char *
+alarm_mode_name(uint8_t mode)
+{
+    switch (mode)
+    {
+        case ALARM_MODE_OFF:   return PSTR("OFF");
+        case ALARM_MODE_SOLID: return PSTR("SOLID");
+        case ALARM_MODE_BLINK: return PSTR("BLINK");
+        default:               return PSTR("UNK");
+    }
+}
+#endif
+
+static const char *
+reg_state_name(app_state_t st)
+{
+    switch (st)
+    {
+        case APP_UNREG: return PSTR("UNREG");
+        case APP_WAIT:  return PSTR("WAIT");
+        case APP_READY: return PSTR("READY");
+        default:        return PSTR("UNK");
+    }
+}
+
+#if FEAT_DIAG
+static const char *
+loop_stage_name(uint8_t id)
+{
+    const sched_task_t *t = sched_task(id);
+    if (t)
+    { return t->name_P; }
+    return id == LOOPSTAT_STALL_SCHED ? PSTR("SCHED") : PSTR("NONE");
+}
+
+/* OK:LOOP:STALL=<task>,MAX=<t0>/<t1>/...  (task order) or
+   OK:LOOP:<task>:<max us>:<c0>,<c1>,...  */
+static void
+send_loopstat(const char *arg, const char *to)
+{
+    char            pl[112];
+    size_t          n;
+    loopstat_task_t ls;
+
+    if (!arg)
+    {
+        n = (size_t)snprintf_P(pl, sizeof(pl), PSTR("OK:LOOP:STALL=%S,MAX="),
+                               loop_stage_name(loopstat_stall()));
+        for (uint8_t id = 0; id < sched_count() && loopstat_get(id, &ls) && n < sizeof(pl); id++)
+        {
+            n += (size_t)snprintf_P(pl + n, sizeof(pl) - n, id ? PSTR("/%lu") : PSTR("%lu"),
+                                    (unsigned long)ls.max_us);
+        }
+        proto_send(to, pl);
+        return;
+    }
+
+    uint8_t id = 0;
+    while (id < sched_count() && strcmp_P(arg, loop_stage_name(id)) != 0)
+    { id++; }
+    const uint16_t *h = loopstat_hist(id);
+    if (id == sched_count() || !h)
+    { proto_send_error_P(PSTR("LOOP"), PSTR("UNK"), to); return; }
+
+    loopstat_get(id, &ls);
+    n = (size_t)snprintf_P(pl, sizeof(pl), PSTR("OK:LOOP:%S:%lu:"),
+                           loop_stage_name(id), (unsigned long)ls.max_us);
+    for (uint8_t i = 0; i < LOOPSTAT_BUCKETS && n < sizeof(pl); i++)
+    {
+        n += (size_t)snprintf_P(pl + n, sizeof(pl) - n,
+                                i ? PSTR(",%u") : PSTR("%u"), h[i]);
+    }
+    proto_send(to, pl);
+}
+
+/* OK:BOOT:HW=<us>,NV=..,SCHED=..,CMD=..,DEFER=..,REG=..,RST=<MCUSR hex>
+   "-" for a phase not reached yet */
+static void
+send_boot(const char *to)
+{
+    static const char names[] PROGMEM = "HW\0NV\0SCHED\0CMD\0DEFER\0REG\0";
+    const char *name = names;
+    char        pl[112];
+    size_t      n = (size_t)snprintf_P(pl, sizeof(pl), PSTR("OK:BOOT:"));
+
+    for (uint8_t p = 0; p < BOOT_PHASE_COUNT && n < sizeof(pl); p++)
+    {
+        uint32_t us;
+        if (boot_at((boot_phase_t)p, &us))
+        {
+            n += (size_t)snprintf_P(pl + n, sizeof(pl) - n, PSTR("%S=%lu,"),
+                                    name, (unsigned long)us);
+        }
+        else
+        { n += (size_t)snprintf_P(pl + n, sizeof(pl) - n, PSTR("%S=-,"), name); }
+        name += strlen_P(name) + 1;
+    }
+    if (n < sizeof(pl))
+    { snprintf_P(pl + n, sizeof(pl) - n, PSTR("RST=%02X"), loopstat_reset_flags()); }
+    proto_send(to, pl);
+}
+
+/* OK:TASK:<id>/<count>:<name>,<prio>,<runs>,<busy ms>,<max us> */
+static void
+send_task(const char *arg, const char *to)
+{
+    uint8_t             id = arg ? (uint8_t)atoi(arg) : 0;
+    const sched_task_t *t  = sched_task(id);
+    if (!t)
+    { proto_send_error_P(PSTR("TASK"), PSTR("RANGE"), to); return; }
+
+    loopstat_task_t ls = { 0, 0, 0 };
+    loopstat_get(id, &ls);
+
+    char pl[80];
+    snprintf_P(pl, sizeof(pl), PSTR("OK:TASK:%u/%u:%S,%u,%lu,%lu,%lu"),
+               id, sched_count(), t->name_P, t->prio, (unsigned long)ls.runs,
+               (unsigned long)ls.busy_ms, (unsigned long)ls.max_us);
+    proto_send(to, pl);
+}
+#endif
+
+#if FEAT_ALARM
+/* one decimal field: at least a digit, no blanks or sign (strtoul skips
+   and takes both); *s is left on the first character after it */
+static bool
+take_ul(const char **s, unsigned long *v)
+{
+    char *end;
+    if (!isdigit((unsigned char)**s))
+    { return false; }
+    *v = strtoul(*s, &end, 10);
+    *s = end;
+    return true;
+}
+
+/* ON:BUZZ[:<prio>[:<period ms>[,<duty %>[,<repeat>[,<ms>]]]]]
+   plain ON:BUZZ is a solid, endless tone at priority 1 */
+static void
+start_buzz(const char *prio, const char *spec, const char *to)
+{
+    AlarmPattern  p = { 1, 0, 100, 0, 0 };
+    unsigned long v = 1;
+    bool          ok = !prio || (take_ul(&prio, &v) && !*prio);
+    ok     = ok && v >= 1 && v <= UINT8_MAX;
+    p.prio = (uint8_t)v;
+
+    if (ok && spec)
+    {
+        unsigned long f[4] = { 0, 50, 0, 0 };
+        for (uint8_t i = 0; ok && i < 4; i++)
+        {
+            ok = take_ul(&spec, &f[i]);
+            if (!ok || i == 3 || *spec != ',')
+            { break; }
+            spec++;
+        }
+        ok = ok && !*spec
+             && f[0] <= UINT8_MAX * (unsigned long)EFFECTS_FRAME_MS && f[1] <= 100
+             && f[2] <= UINT8_MAX && f[3] <= UINT16_MAX * (unsigned long)EFFECTS_FRAME_MS;
+        p.period_ms = (uint16_t)f[0];
+        p.duty      = (uint8_t)f[1];
+        p.repeat    = (uint8_t)f[2];
+        p.left_ms   = f[3];
+    }
+
+    if (!ok)
+    { proto_send_error_P(PSTR("BUZZ"), PSTR("RANGE"), to); }
+    else if (!alarm_start(&p))
+    { proto_send_error_P(PSTR("BUZZ"), PSTR("BUSY"), to); }
+    else
+    { proto_send_ok_P(PSTR("BUZZ"), to); }
+}
+
+/* OK:BUZZ:ON/OFF[:<prio>=<period ms>,<duty %>,<repeat>,<ms left>;..]
+   highest priority (the one sounding) first */
+static void
+send_buzz(const char *to)
+{
+    char         pl[128];
+    AlarmPattern p;
+    size_t       n = (size_t)snprintf_P(pl, sizeof(pl), PSTR("OK:BUZZ:%S"),
+                                        alarm_sounding() ? PSTR("ON") : PSTR("OFF"));
+
+    for (uint8_t i = 0; alarm_pattern(i, &p) && n < sizeof(pl); i++)
+    {
+        n += (size_t)snprintf_P(pl + n, sizeof(pl) - n, PSTR("%c%u=%u,%u,%u,%lu"),
+                                i ? ';' : ':', p.prio, p.period_ms, p.duty,
+                                p.repeat, (unsigned long)p.left_ms);
+    }
+    proto_send(to, pl);
+}
+#endif
+
+#if FEAT_TRACE
+static const char *
+token_name(uint8_t id, const char *list_P)
+{
+    for (uint8_t i = 1; id && pgm_read_byte(list_P); i++)
+    {
+        if (i == id)
+        { return list_P; }
+        list_P += strlen_P(list_P) + 1;
+    }
+    return PSTR("?");
+}
+
+/* OK:TRACE:<next>/<count>:<ms>,<verb>,<noun>,<res>,<us>;...  oldest first;
+   up to TRACE_PAGE entries, ask again from <next> until it reaches <count> */
+static void
+send_trace(const char *arg, const char *to)
+{
+    uint8_t idx = arg ? (uint8_t)atoi(arg) : 0;
+    char    pl[128];
+    char    body[104];
+    size_t  n = 0;
+
+    trace_entry_t e;
+    for (uint8_t i = 0; i < TRACE_PAGE && trace_get(idx, &e); i++, idx++)
+    {
+        const char *verb = e.verb >= TRACE_EV_BOOT
+                         ? token_name((uint8_t)(e.verb - TRACE_EV_BOOT + 1), s_event_ids)
+                         : token_name(e.verb, s_verb_ids);
+        const char *res  = e.result == TRACE_RES_OK  ? PSTR("OK")
+                         : e.result == TRACE_RES_ERR ? PSTR("ERR") : PSTR("-");
+
+        size_t len = (size_t)snprintf_P(body + n, sizeof(body) - n, PSTR("%c%lu,%S,%S,%S,%u"),
+                                        i ? ';' : ':', (unsigned long)e.t_ms, verb,
+                                        token_name(e.noun, s_noun_ids), res, e.dur_us);
+        if (n + len >= sizeof(body))
+        { break; } /* whole entries only, this one leads the next page */
+        n += len;
+    }
+    body[n] = '\0';
+
+    snprintf_P(pl, sizeof(pl), PSTR("OK:TRACE:%u/%u%s"), idx, trace_count(), body);
+    proto_send(to, pl);
+}
+#endif
+
+#if PROF_ENABLE
+/* OK:PROF:<next>/<buckets>:<samples>,<out>,<base>,<shift>,<run>:<i>=<n>,...
+   non-empty buckets only; ask again from <next> until it reaches <buckets> */
+static void
+send_prof(const char *arg, const char *to)
+{
+    uint8_t     i = arg ? (uint8_t)atoi(arg) : 0;
+    char        pl[128];
+    char        body[96];
+    size_t      n = 0;
+    prof_info_t pi;
+    prof_info(&pi);
+
+    for (; i < PROF_BUCKETS && n < sizeof(body) - 12; i++)
+    {
+        uint16_t c = prof_bucket(i);
+        if (c)
+        { n += (size_t)snprintf_P(body + n, sizeof(body) - n, PSTR("%c%u=%u"), n ? ',' : ':', i, c); }
+    }
+    body[n] = '\0';
+
+    snprintf_P(pl, sizeof(pl), PSTR("OK:PROF:%u/%u:%u,%u,%u,%u,%u%s"),
+               i, PROF_BUCKETS, pi.samples, pi.out, pi.base, pi.shift, pi.running, body);
+    proto_send(to, pl);
+}
+#endif
+
+#if FEAT_STATE
+static int
+format_field(char *buf, size_t cap, state_field_t f)
+{
+    uint8_t       v = state_value(f);
+    uint8_t       ch;
+    state_field_t kind = state_field_kind(f, &ch);
+    char          sfx[4] = "";  /* channel suffix, none for channel 0 */
+    if (ch)
+    { utoa(ch, sfx, 10); }
+
+    switch (kind)
+    {
+        /* lamp relay is active-low, see ON:LAMP */
+        case STATE_LAMP:   return snprintf_P(buf, cap, v ? PSTR("LAMP=OFF") : PSTR("LAMP=ON"));
+        case STATE_LED:    return snprintf_P(buf, cap, PSTR("LED%s=%S"), sfx, v ? PSTR("ON") : PSTR("OFF"));
+        case STATE_MODE:   return snprintf_P(buf, cap, PSTR("MODE%s=%S"), sfx, led_mode_name(v));
+        case STATE_BRIGHT: return snprintf_P(buf, cap, PSTR("BRIGHT%s=%u"), sfx, v);
+        case STATE_ALARM:  return snprintf_P(buf, cap, PSTR("ALARM=%S"), alarm_mode_name(v));
+        default:           return 0;
+    }
+}
+
+/* OK:ALL:<ver>:<k=v,...>,UPTIME=..,<s_all_cfg>  or  OK:SINCE:<ver>[:<k=v,...>] */
+static void
+send_state(const char *topic_P, bool all, uint16_t since, const char *to)
+{
+    char   pl[112 + 32 * (LED_CHANNELS - 1)];
+    _Static_assert(sizeof(pl) - 1 + sizeof(s_all_cfg) - 1 <= PROTO_PAYLOAD_MAX,
+                   "GET:ALL exceeds PROTO_PAYLOAD_MAX");
+    size_t n = (size_t)snprintf_P(pl, sizeof(pl), PSTR("OK:%S:%u"), topic_P, state_version());
+    char   sep = ':';
+
+    for (uint8_t i = 0; i < STATE_FIELD_COUNT && n < sizeof(pl) - 1; i++)
+    {
+        if (!all && !state_changed_since((state_field_t)i, since))
+        { continue; }
+
+        pl[n++] = sep;
+        sep = ',';
+        n += (size_t)format_field(pl + n, sizeof(pl) - n, (state_field_t)i);
+    }
+
+    if (all && n < sizeof(pl))
+    { snprintf_P(pl + n, sizeof(pl) - n, PSTR(",UPTIME=%lu"), (unsigned long)timer_now()); }
+
+    frame_begin(to);
+    uart_write_str(pl);
+    if (all)
+    { uart_write_str_P(s_all_cfg); }
+    frame_end();
+}
+
+#endif
+
+#if FEAT_CFG
+/* Whole persisted configuration as one hex blob of nv_state_t, including
+   magic, version and crc8, so it is checked end to end. */
+static void
+send_cfg(const char *to)
+{
+    nv_state_t nv = s_nv;
+    storage_seal(&nv);
+
+    char pl[8 + 2 * sizeof(nv_state_t) + 1];
+    strcpy_P(pl, PSTR("OK:CFG:"));
+    hex_encode((const uint8_t *)&nv, sizeof(nv), pl + 7);
+    proto_send(to, pl);
+}
+
+static void
+set_cfg(const char *hex, const char *to)
+{
+    nv_state_t nv;
+    if (!hex_decode(hex, (uint8_t *)&nv, sizeof(nv)))
+    { proto_send_error_P(PSTR("CFG"), PSTR("FORMAT"), to); return; }
+    if (!storage_check(&nv))
+    { proto_send_error_P(PSTR("CFG"), PSTR("CRC"), to); return; }
+#if FEAT_LED
+    for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+    {
+        if (nv.led[ch].mode < LED_MODE_SOLID || nv.led[ch].mode > LED_MODE_BLINK)
+        { proto_send_error_P(PSTR("CFG"), PSTR("RANGE"), to); return; }
+    }
+#endif
+
+    /* everything applied, then a single EEPROM commit */
+    apply_nv(&nv);
+    s_nv = nv;
+#if FEAT_LED
+    for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+    { s_nv.led[ch] = effects_get(ch); }
+#endif
+    storage_save(&s_nv);
+    proto_send_ok_P(PSTR("CFG"), to);
+}
+#endif
+
+#if FEAT_PRESET
+static void
+save_preset(uint8_t n, const char *to)
+{
+    preset_t p;
+    p.lamp_on = lamp_get();
+#if FEAT_LED
+    for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+    { p.led[ch] = effects_get(ch); }
+#endif
+#if FEAT_ALARM
+    p.alarm_mode = (uint8_t)alarm_get_mode();
+#else
+    p.alarm_mode = 0;
+#endif
+    storage_preset_put(n, &p);
+    proto_send_ok_P(PSTR("PRESET"), to);
+}
+
+/* Everything is applied inside this one command, so a single state
+   version and a single EEPROM commit cover the whole scene; with ms > 0
+   brightness ramps there while mode, lamp and alarm switch at once. */
+static void
+load_preset(uint8_t n, uint16_t ms, const char *to)
+{
+    preset_t p;
+    if (!storage_preset_get(n, &p))
+    { proto_send_error_P(PSTR("PRESET"), PSTR("EMPTY"), to); return; }
+
+    lamp_set(p.lamp_on);
+    s_nv.lamp_on = p.lamp_on;
+#if FEAT_LED
+    for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+    {
+        const led_state_t *l = &p.led[ch];
+        if (l->mode < LED_MODE_SOLID || l->mode > LED_MODE_BLINK)
+        { continue; }
+
+        effects_set_mode(ch, l->mode);
+        effects_set_state(ch, l->state);
+        effects_fade_to(ch, l->brightness, ms);
+        effects_set_auto(ch, l->auto_bright);
+
+        s_nv.led[ch] = effects_get(ch);
+        s_nv.led[ch].brightness = l->brightness; /* persist the target */
+    }
+#else
+    (void)ms;
+#endif
+#if FEAT_ALARM
+    if (p.alarm_mode <= ALARM_MODE_BLINK)
+    { alarm_set_mode((AlarmMode)p.alarm_mode); }
+#endif
+    storage_save(&s_nv);
+    proto_send_ok_P(PSTR("PRESET"), to);
+}
+#endif
+
 static void
 handle_cmd(char *to, char *payload, char *from)
 {
     trim(to); trim(payload); trim(from);
 
-    if (strcmp(to, "VERTEX") != 0 && strcmp(to, "ALL") != 0)
+    /* normally already filtered in the RX ISR, kept for RX_ADDR_FILTER=0 */
+    if (strcmp_P(to, PSTR(NODE_ADDR)) != 0 && strcmp_P(to, PSTR("ALL")) != 0)
     {
         return; /* not for us */
     }
+    if (strlen(from) > PROTO_ADDR_MAX)
+    {
+        return; /* the reply would not fit PROTO_REPLY_MAX */
+    }
+    boot_mark(BOOT_CMD);
+
+    /* on a shared bus, answers to a broadcast go out in our own slot,
+       counted from the line's arrival, not from dispatch; a line that
+       waited past its slot is answered right away */
+    if (strcmp_P(to, PSTR("ALL")) == 0)
+    {
+        uint16_t slot = RS485_GUARD_MS + NODE_SLOT * RS485_SLOT_MS;
+        uint16_t age  = cmdq_age_ms();
+        uart_tx_defer(age < slot ? (uint16_t)(slot - age) : 0);
+    }
 
     /* Top-level verbs inside payload: VERB:NOUN[:ARGS] */
-    char *verb = strtok(payload, ":");
-    char *noun = strtok(NULL, ":");
-    char *arg1 = strtok(NULL, ":");
-    char *arg2 = strtok(NULL, ":");
+    const char delim[] = { ':', '\0' }; /* immediate stores, not .rodata */
+    char *verb = strtok(payload, delim);
+    char *noun = strtok(NULL, delim);
+    char *arg1 = strtok(NULL, delim);
+    char *arg2 = strtok(NULL, delim);
+    char *arg3 = strtok(NULL, delim);
+
+    if (verb && verb[0] == '#')
+    {
+        s_seq    = (uint16_t)strtoul(verb + 1, NULL, 10);
+        s_seq_on = true;
+        verb = noun; noun = arg1; arg1 = arg2; arg2 = arg3;
+        arg3 = strtok(NULL, delim);
+    }
+
+    s_tr_verb = 0; /* set by IS_VERB / IS_NOUN where dispatch matches */
+    s_tr_noun = 0;
 
     if (!verb)
     {
-        proto_send_error("VERB", "EMPTY", from);
+        proto_send_error_P(PSTR("VERB"), PSTR("EMPTY"), from);
         return;
     }
 
-    if (strcmp(verb, "PING") == 0)
+    if (IS_VERB(PING))
     {
-        proto_send(from, "PONG:PONG");
+        proto_send_P(from, PSTR("PONG:PONG"));
+        return;
+    }
+
+    if (IS_VERB(REG))
+    {
+        /* REG:ACK completes the handshake; REG:REQ (e.g. broadcast by a
+           restarted obelisk) makes us re-register after a random delay.
+           Neither is answered, to keep broadcasts from echoing. */
+        if (noun && IS_NOUN(ACK))
+        { reg_ack(); }
+        else if (noun && IS_NOUN(REQ))
+        { reg_restart((uint16_t)(REG_ACK_TIMEOUT_MS / 2)); }
         return;
     }
 
     if (!noun)
     {
-        proto_send_error("NOUN", "EMPTY", from);
+        proto_send_error_P(PSTR("NOUN"), PSTR("EMPTY"), from);
         return;
     }
 
-    if (strcmp(verb, "ON") == 0)
+    /* LED takes an optional channel right after the noun (ON:LED:2,
+       SET:LED:1:BRIGHT:80); without one it means channel 0 */
+#if FEAT_LED
+    uint8_t ch = 0;
+    if (IS_NOUN(LED) && arg1 && isdigit((unsigned char)arg1[0]))
+    {
+        unsigned long n = strtoul(arg1, NULL, 10);
+        if (n >= LED_CHANNELS)
+        { proto_send_error_P(PSTR("LED"), PSTR("CHAN"), from); return; }
+        ch   = (uint8_t)n;
+        arg1 = arg2; arg2 = arg3;
+    }
+#else
+    (void)arg3;
+#endif
+
+    if (IS_VERB(ON))
     {
-        if (strcmp(noun, "LAMP") == 0)
+        if (IS_NOUN(LAMP))
         {
             lamp_set(0);
             s_nv.lamp_on = 0;
             storage_save(&s_nv);
-            proto_send_ok("LAMP", from);
+            proto_send_ok_P(PSTR("LAMP"), from);
         }
-        else if (strcmp(noun, "LED") == 0)
+#if FEAT_LED
+        else if (IS_NOUN(LED))
         {
-            effects_set_state(1);
-            s_nv.led = effects_get();
+            effects_set_state(ch, 1);
+            s_nv.led[ch] = effects_get(ch);
             storage_save(&s_nv);
-            proto_send_ok("LED", from);
+            proto_send_ok_P(PSTR("LED"), from);
         }
-        else if (strcmp(noun, "BUZZ") == 0)
+#endif
+#if PROF_ENABLE
+        else if (IS_NOUN(PROF))
         {
-            buzzer_set(1);
-            proto_send_ok("BUZZ", from);
+            /* ON:PROF[:<base word address>[:<shift>]] restarts from zero */
+            unsigned long base  = arg1 ? strtoul(arg1, NULL, 0) : 0;
+            unsigned long shift = arg2 ? strtoul(arg2, NULL, 10) : 8;
+            if (base > UINT16_MAX || shift > 15)
+            { proto_send_error_P(PSTR("PROF"), PSTR("RANGE"), from); return; }
+            prof_start((uint16_t)base, (uint8_t)shift);
+            proto_send_ok_P(PSTR("PROF"), from);
         }
+#endif
+#if FEAT_ALARM
+        else if (IS_NOUN(BUZZ))
+        {
+            start_buzz(arg1, arg2, from);
+        }
+#endif
         else
         {
-            proto_send_error("NOUN", "UNK", from);
+            proto_send_error_P(PSTR("NOUN"), PSTR("UNK"), from);
         }
     }
-    else if (strcmp(verb, "OFF") == 0)
+    else if (IS_VERB(OFF))
     {
-        if (strcmp(noun, "LAMP") == 0)
+        if (IS_NOUN(LAMP))
         {
             lamp_set(1);
             s_nv.lamp_on = 1;
             storage_save(&s_nv);
-            proto_send_ok("LAMP", from);
+            proto_send_ok_P(PSTR("LAMP"), from);
         }
-        else if (strcmp(noun, "LED") == 0)
+#if FEAT_LED
+        else if (IS_NOUN(LED))
         {
-            effects_set_state(0);
-            s_nv.led = effects_get();
+            effects_set_state(ch, 0);
+            s_nv.led[ch] = effects_get(ch);
             storage_save(&s_nv);
-            proto_send_ok("LED", from);
+            proto_send_ok_P(PSTR("LED"), from);
         }
-        else if (strcmp(noun, "BUZZ") == 0)
+#endif
+#if PROF_ENABLE
+        else if (IS_NOUN(PROF))
         {
-            buzzer_set(0);
-            proto_send_ok("BUZZ", from);
+            prof_stop();
+            proto_send_ok_P(PSTR("PROF"), from);
         }
+#endif
+#if FEAT_ALARM
+        else if (IS_NOUN(BUZZ))
+        {
+            /* OFF:BUZZ:<prio> ends one pattern, OFF:BUZZ all and the mode */
+            const char   *c    = arg1;
+            unsigned long prio = 0;
+            if (c && (!take_ul(&c, &prio) || *c || prio > UINT8_MAX))
+            { proto_send_error_P(PSTR("BUZZ"), PSTR("RANGE"), from); return; }
+            if (arg1)
+            { alarm_stop((uint8_t)prio); }
+            else
+            { alarm_stop_all(); }
+            proto_send_ok_P(PSTR("BUZZ"), from);
+        }
+#endif
         else
         {
-            proto_send_error("NOUN", "UNK", from);
+            proto_send_error_P(PSTR("NOUN"), PSTR("UNK"), from);
         }
     }
-    else if (strcmp(verb, "TOGGLE") == 0)
+    else if (IS_VERB(TOGGLE))
     {
-        if (strcmp(noun, "LAMP") == 0)
+        if (IS_NOUN(LAMP))
         {
             lamp_set(!lamp_get());
             s_nv.lamp_on = lamp_get();
             storage_save(&s_nv);
-            proto_send_ok("LAMP", from);
+            proto_send_ok_P(PSTR("LAMP"), from);
         }
-        else if (strcmp(noun, "LED") == 0)
+#if FEAT_LED
+        else if (IS_NOUN(LED))
         {
-            led_state_t st = effects_get();
-            effects_set_state(!st.state);
-            s_nv.led = effects_get();
+            led_state_t st = effects_get(ch);
+            effects_set_state(ch, !st.state);
+            s_nv.led[ch] = effects_get(ch);
             storage_save(&s_nv);
-            proto_send_ok("LED", from);
+            proto_send_ok_P(PSTR("LED"), from);
         }
+#endif
         else
         {
-            proto_send_error("NOUN", "UNK", from);
+            proto_send_error_P(PSTR("NOUN"), PSTR("UNK"), from);
         }
     }
-    else if (strcmp(verb, "SET") == 0)
+    else if (IS_VERB(SET))
     {
-        if (strcmp(noun, "LED") == 0)
+#if FEAT_LED
+        if (IS_NOUN(LED))
         {
             if (!arg1)
-            { proto_send_error("ARG1", "EMPTY", from); return; }
+            { proto_send_error_P(PSTR("ARG1"), PSTR("EMPTY"), from); return; }
             if (!arg2)
-            { proto_send_error("ARG2", "EMPTY", from); return; }
+            { proto_send_error_P(PSTR("ARG2"), PSTR("EMPTY"), from); return; }
 
-            if (strcmp(arg1, "MODE") == 0)
+            if (strcmp_P(arg1, PSTR("MODE")) == 0)
             {
-                if (strcmp(arg2, "BLINK") == 0)
-                { effects_set_mode(LED_MODE_BLINK); }
-                else if (strcmp(arg2, "SOLID") == 0)
-                { effects_set_mode(LED_MODE_SOLID); }
-                else if (strcmp(arg2, "FADE") == 0)
-                { effects_set_mode(LED_MODE_FADE); }
+                if (strcmp_P(arg2, PSTR("BLINK")) == 0)
+                { effects_set_mode(ch, LED_MODE_BLINK); }
+                else if (strcmp_P(arg2, PSTR("SOLID")) == 0)
+                { effects_set_mode(ch, LED_MODE_SOLID); }
+                else if (strcmp_P(arg2, PSTR("FADE")) == 0)
+                { effects_set_mode(ch, LED_MODE_FADE); }
                 else
-                { proto_send_error("LED:MODE", "UNK", from); return; }
+                { proto_send_error_P(PSTR("LED:MODE"), PSTR("UNK"), from); return; }
+            }
+            else if (strcmp_P(arg1, PSTR("BRIGHT")) == 0 && strcmp_P(arg2, PSTR("AUTO")) == 0)
+            {
+#if AMBIENT_ENABLE
+                effects_set_auto(ch, 1);
+#else
+                proto_send_error_P(PSTR("LED:BRIGHT"), PSTR("NOSENSOR"), from);
+                return;
+#endif
             }
-            else if (strcmp(arg1, "BRIGHT") == 0)
+            else if (strcmp_P(arg1, PSTR("BRIGHT")) == 0)
             {
                 int v = atoi(arg2);
                 if (v < 0) { v = 0; }
                 if (v > 255) { v = 255; }
-                effects_set_brightness((uint8_t)v);
+                effects_set_auto(ch, 0);
+                effects_set_brightness(ch, (uint8_t)v);
             }
             else
             {
-                proto_send_error("LED", "UNK", from);
+                proto_send_error_P(PSTR("LED"), PSTR("UNK"), from);
                 return;
             }
 
-            s_nv.led = effects_get();
+            s_nv.led[ch] = effects_get(ch);
             storage_save(&s_nv);
-            proto_send_ok("LED", from);
+            proto_send_ok_P(PSTR("LED"), from);
         }
         else
+#endif
+#if FEAT_CFG
+        if (IS_NOUN(CFG))
         {
-            proto_send_error("NOUN", "UNK", from);
+            if (!arg1)
+            { proto_send_error_P(PSTR("ARG1"), PSTR("EMPTY"), from); return; }
+            set_cfg(arg1, from);
+        }
+        else
+#endif
+        {
+            proto_send_error_P(PSTR("NOUN"), PSTR("UNK"), from);
         }
     }
-    else if (strcmp(verb, "GET") == 0)
+    else if (IS_VERB(GET))
     {
-        if (strcmp(noun, "LAMP") == 0)
+        if (IS_NOUN(LAMP))
         {
             if (!arg1)
-            { proto_send_error("ARG1", "EMPTY", from); return; }
+            { proto_send_error_P(PSTR("ARG1"), PSTR("EMPTY"), from); return; }
 
-            if (strcmp(arg1, "STATE") == 0)
+            if (strcmp_P(arg1, PSTR("STATE")) == 0)
             {
                 if (!lamp_get())
-                { proto_send_ok("LAMP:STATE:ON", from); }
+                { proto_send_ok_P(PSTR("LAMP:STATE:ON"), from); }
                 else
-                { proto_send_ok("LAMP:STATE:OFF", from); }
+                { proto_send_ok_P(PSTR("LAMP:STATE:OFF"), from); }
             }
             else
             {
-                proto_send_error("LAMP", "UNK", from);
+                proto_send_error_P(PSTR("LAMP"), PSTR("UNK"), from);
             }
         }
-        else if (strcmp(noun, "LED") == 0)
+#if FEAT_LED
+        else if (IS_NOUN(LED))
         {
             if (!arg1)
-            { proto_send_error("ARG1", "EMPTY", from); return; }
+            { proto_send_error_P(PSTR("ARG1"), PSTR("EMPTY"), from); return; }
 
-            led_state_t state = effects_get();
+            led_state_t state = effects_get(ch);
 
-            if (strcmp(arg1, "MODE") == 0)
+            if (strcmp_P(arg1, PSTR("MODE")) == 0)
             {
                 if (state.mode == LED_MODE_FADE)
-                { proto_send_ok("LED:MODE:FADE", from); }
+                { proto_send_ok_P(PSTR("LED:MODE:FADE"), from); }
                 else if (state.mode == LED_MODE_BLINK)
-                { proto_send_ok("LED:MODE:BLINK", from); }
+                { proto_send_ok_P(PSTR("LED:MODE:BLINK"), from); }
                 else if (state.mode == LED_MODE_SOLID)
-                { proto_send_ok("LED:MODE:SOLID", from); }
+                { proto_send_ok_P(PSTR("LED:MODE:SOLID"), from); }
             }
-            else if (strcmp(arg1, "STATE") == 0)
+            else if (strcmp_P(arg1, PSTR("STATE")) == 0)
             {
                 if (state.state)
-                { proto_send_ok("LED:STATE:ON", from); }
+                { proto_send_ok_P(PSTR("LED:STATE:ON"), from); }
                 else
-                { proto_send_ok("LED:STATE:OFF", from); }
+                { proto_send_ok_P(PSTR("LED:STATE:OFF"), from); }
             }
-            else if (strcmp(arg1, "BRIGHT") == 0)
+            else if (strcmp_P(arg1, PSTR("BRIGHT")) == 0)
             {
                 char pl[48];
-                snprintf(pl, sizeof(pl), "OK:LED:BRIGHT:%d", state.brightness);
+                snprintf_P(pl, sizeof(pl), PSTR("OK:LED:BRIGHT:%d%S"), state.brightness,
+                           state.auto_bright ? PSTR(":AUTO") : PSTR(""));
                 proto_send(from, pl);
             }
             else
             {
-                proto_send_error("LED", "UNK", from);
+                proto_send_error_P(PSTR("LED"), PSTR("UNK"), from);
             }
         }
-        else if (strcmp(noun, "UPTIME") == 0)
+#endif
+#if FEAT_CFG
+        else if (IS_NOUN(CFG))
+        {
+            send_cfg(from);
+        }
+#endif
+#if FEAT_STATE
+        else if (IS_NOUN(ALL))
+        {
+            state_sync();
+            send_state(PSTR("ALL"), true, 0, from);
+        }
+        else if (IS_NOUN(SINCE))
+        {
+            if (!arg1)
+            { proto_send_error_P(PSTR("ARG1"), PSTR("EMPTY"), from); return; }
+
+            state_sync();
+            send_state(PSTR("SINCE"), false, (uint16_t)strtoul(arg1, NULL, 10), from);
+        }
+#endif
+        else if (IS_NOUN(REG))
+        {
+            /* streamed, so minimal profiles link no printf */
+            char num[11];
+            frame_begin(from);
+            uart_write_str_P(PSTR("OK:REG:"));
+            uart_write_str_P(reg_state_name(s_state));
+            uart_write_str_P(PSTR(":"));
+            uart_write_str(utoa(s_reg_tries, num, 10));
+            uart_write_str_P(PSTR(":"));
+            uart_write_str(ultoa(s_reg_ms, num, 10));
+            frame_end();
+        }
+#if FEAT_DIAG
+        else if (IS_NOUN(MEM))
+        {
+            mem_stats_t m;
+            mem_stats(&m);
+            char pl[80];
+            snprintf_P(pl, sizeof(pl),
+                       PSTR("OK:MEM:STATIC=%u,HEAP=%u/%u,FREE=%u,STACK=%u,GAP=%u"),
+                       m.static_sz, m.heap_cur, m.heap_peak, m.heap_free,
+                       m.stack_peak, m.stack_gap);
+            proto_send(from, pl);
+        }
+        else if (IS_NOUN(RX))
+        {
+            char pl[72];
+#if RS485_ENABLE
+            snprintf_P(pl, sizeof(pl), PSTR("OK:RX:FILTERED=%u,OVF=%u,SLOT=%u,SLOT_MS=%u,GUARD_MS=%u"),
+                       uart_rx_filtered(), uart_rx_overflows(), NODE_SLOT,
+                       RS485_SLOT_MS, RS485_GUARD_MS);
+#else
+            snprintf_P(pl, sizeof(pl), PSTR("OK:RX:FILTERED=%u,OVF=%u"),
+                       uart_rx_filtered(), uart_rx_overflows());
+#endif
+            proto_send(from, pl);
+        }
+        else if (IS_NOUN(QUEUE))
+        {
+            cmdq_stats_t q;
+            cmdq_stats(&q);
+            char pl[64];
+            snprintf_P(pl, sizeof(pl),
+                       PSTR("OK:QUEUE:LEN=%u/%u,PEAK=%u,SHED=%u,THROTTLED=%u"),
+                       q.len, CMDQ_DEPTH, q.peak, q.shed, q.throttled);
+            proto_send(from, pl);
+        }
+#endif
+#if FEAT_TRACE
+        else if (IS_NOUN(TRACE))
+        {
+            send_trace(arg1, from);
+        }
+#endif
+#if FEAT_DIAG
+        else if (IS_NOUN(LOOP))
+        {
+            send_loopstat(arg1, from);
+        }
+        else if (IS_NOUN(TASK))
+        {
+            send_task(arg1, from);
+        }
+        else if (IS_NOUN(BOOT))
+        {
+            send_boot(from);
+        }
+#endif
+#if FEAT_DIAG && FEAT_LED
+        else if (IS_NOUN(LAT))
+        {
+            char pl[48];
+            snprintf_P(pl, sizeof(pl), PSTR("OK:LAT:TICK_MAX=%lu"),
+                       (unsigned long)effects_tick_gap_max());
+            proto_send(from, pl);
+        }
+#endif
+#if FEAT_ALARM
+        else if (IS_NOUN(BUZZ))
+        {
+            send_buzz(from);
+        }
+#endif
+#if PROF_ENABLE
+        else if (IS_NOUN(PROF))
+        {
+            send_prof(arg1, from);
+        }
+#endif
+#if AMBIENT_ENABLE
+        else if (IS_NOUN(AMBIENT))
         {
             char pl[48];
-            snprintf(pl, sizeof(pl), "OK:UPTIME:%lu", (unsigned long)timer_now());
+            snprintf_P(pl, sizeof(pl), PSTR("OK:AMBIENT:RAW=%u,LEVEL=%u"),
+                       ambient_raw(), ambient_level());
             proto_send(from, pl);
         }
+#endif
+#if WS2812_ENABLE
+        else if (IS_NOUN(STRIP))
+        {
+            char pl[48];
+            snprintf_P(pl, sizeof(pl), PSTR("OK:STRIP:PIXELS=%u,FRAMES=%u,US=%u"),
+                       WS2812_PIXELS, ws2812_frames(), ws2812_frame_us());
+            proto_send(from, pl);
+        }
+#endif
+        else if (IS_NOUN(UPTIME))
+        {
+            char num[11];
+            frame_begin(from);
+            uart_write_str_P(PSTR("OK:UPTIME:"));
+            uart_write_str(ultoa(timer_now(), num, 10));
+            frame_end();
+        }
         else
         {
-            proto_send_error("NOUN", "UNK", from);
+            proto_send_error_P(PSTR("NOUN"), PSTR("UNK"), from);
         }
     }
+#if FEAT_PRESET
+    else if (IS_VERB(SAVE) || IS_VERB(LOAD))
+    {
+        if (!IS_NOUN(PRESET))
+        { proto_send_error_P(PSTR("NOUN"), PSTR("UNK"), from); return; }
+        if (!arg1)
+        { proto_send_error_P(PSTR("ARG1"), PSTR("EMPTY"), from); return; }
+
+        unsigned long n = strtoul(arg1, NULL, 10);
+        if (!isdigit((unsigned char)arg1[0]) || n >= PRESET_COUNT)
+        { proto_send_error_P(PSTR("PRESET"), PSTR("RANGE"), from); return; }
+
+        if (verb[0] == 'S')
+        { save_preset((uint8_t)n, from); }
+        else
+        {
+            unsigned long ms = arg2 ? strtoul(arg2, NULL, 10) : 0;
+            load_preset((uint8_t)n, ms > UINT16_MAX ? UINT16_MAX : (uint16_t)ms, from);
+        }
+    }
+#endif
     else
     {
-        proto_send_error("VERB", "UNK", from);
+        proto_send_error_P(PSTR("VERB"), PSTR("UNK"), from);
     }
 }
 
 void
 proto_poll(void)
 {
-    /* Read bytes into line buffer up to \n */
-    uint8_t b;
-    while (uart_read_byte(&b))
+    reg_tick();
+    uart_poll();
+
+    uint16_t ovf = uart_rx_overflows();
+    if (ovf != s_tr_ovf)
     {
-        if (b == '\n')
+        trace_record(TRACE_EV_RXOVF, 0, TRACE_RES_NONE, (uint16_t)(ovf - s_tr_ovf));
+        s_tr_ovf = ovf;
+    }
+
+    /* Frame bytes into the command queue, within the per-pass budget;
+       a partial line simply stays in the queue pool for the next pass,
+       and with the pool full of actuations bytes wait in the RX ring */
+    uint32_t t0    = timer_now_us();
+    uint8_t  lines = 0;
+    uint8_t  bytes = 0;
+    uint8_t  b;
+    while (bytes < PROTO_BUDGET_BYTES && cmdq_room() && uart_read_byte(&b))
+    {
+        bytes++;
+        if (cmdq_feed(b) == CMDQ_OVERFLOW)
         {
-            s_rxline[s_rxlen] = '\0';
-            char *to = NULL, *pay = NULL, *from = NULL;
-            if (!parse_packet_alloc(s_rxline, &to, &pay, &from))
-            { 
-                proto_send_error("PROTO", "FORMAT", "ALL");
-            }
-            else if (to && pay && from)
-            {
-                handle_cmd(to, pay, from);
-            }
-            s_rxlen = 0;
-            free(to);
-            free(pay);
-            free(from);
+            trace_record(TRACE_EV_LINEOVF, 0, TRACE_RES_ERR, 0);
+            broadcast_error_P(PSTR("GEN"), PSTR("OVF"));
         }
-        else
+    }
+
+    /* then run the most urgent queued commands */
+    char *line;
+    while (lines < PROTO_BUDGET_LINES && uart_tx_ready(PROTO_REPLY_MAX) && cmdq_next(&line))
+    {
+        char *to = NULL, *pay = NULL, *from = NULL;
+#if FEAT_HEAP
+        bool parsed = parse_packet_alloc(line, &to, &pay, &from);
+#if FEAT_DIAG
+        mem_sample();
+#endif
+#else
+        bool parsed = parse_packet_inplace(line, &to, &pay, &from);
+#endif
+        if (!parsed)
+        { 
+            trace_record(TRACE_EV_FORMAT, 0, TRACE_RES_ERR, 0);
+            broadcast_error_P(PSTR("PROTO"), PSTR("FORMAT"));
+        }
+        else if (to && pay && from)
         {
-            if (s_rxlen < (RX_LINE_MAX - 1))
-            {
-                s_rxline[s_rxlen++] = (char)b;
-            }
-            else
+            uint32_t t_cmd = timer_now_us();
+            s_tr_verb = TRACE_NOT_OURS;
+            s_tr_res  = TRACE_RES_NONE;
+
+            handle_cmd(to, pay, from);
+            s_seq_on = false;
+            state_sync();
+
+            if (s_tr_verb != TRACE_NOT_OURS)
             {
-                /* overflow, reset */
-                s_rxlen = 0;
-                proto_send_error("GEN", "OVF", "ALL");
+                uint32_t dt = timer_now_us() - t_cmd;
+                trace_record(s_tr_verb, s_tr_noun, s_tr_res,
+                             dt > UINT16_MAX ? UINT16_MAX : (uint16_t)dt);
             }
         }
+        cmdq_done();
+#if FEAT_HEAP
+        free(to);
+        free(pay);
+        free(from);
+#endif
+
+        lines++;
+        if ((timer_now_us() - t0) >= PROTO_BUDGET_US)
+        { break; }
+    }
+}
+
+/* wakes on RX; registration retries and the RS-485 TX gate are timed,
+   queued commands keep it runnable */
+static char
+proto_task(sched_task_t *t)
+{
+    PT_BEGIN(&t->pt);
+    for (;;)
+    {
+        proto_poll();
+        if (cmdq_len() && uart_tx_ready(PROTO_REPLY_MAX))
+        { SCHED_WAIT(t, SCHED_EV_NOW); }
+#if RS485_ENABLE
+        else
+        { SCHED_WAIT_UNTIL(t, timer_now() + 1, SCHED_EV_RX); }
+#else
+        else if (cmdq_len())
+        { SCHED_WAIT_UNTIL(t, timer_now() + 1, SCHED_EV_RX); } /* TX draining */
+        else if (s_state == APP_READY || !s_reg_tim.start)
+        { SCHED_WAIT(t, SCHED_EV_RX); } /* READY, or before proto_boot */
+        else
+        { SCHED_WAIT_UNTIL(t, timer_deadline(&s_reg_tim), SCHED_EV_RX); }
+#endif
     }
+    PT_END(&t->pt);
 }
 
@@ -0,0 +1,138 @@
+#include "sched.h"
+#include "loopstat.h"
+#include "uart.h"
+#include "config.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+
+static sched_task_t *s_head  = NULL;
+static uint8_t       s_count = 0;
+
+void
+sched_add(sched_task_t *t)
+{
+    s_count++;
+    if (!s_head || t->prio < s_head->prio)
+    {
+        t->next = s_head;
+        s_head  = t;
+        return;
+    }
+
+    /* after the last task of the same priority */
+    sched_task_t *p = s_head;
+    while (p->next && p->next->prio <= t->prio)
+    { p = p->next; }
+    t->next = p->next;
+    p->next = t;
+}
+
+void
+sched_signal(sched_task_t *t)
+{
+    t->signal = 1;
+}
+
+uint8_t
+sched_count(void)
+{
+    return s_count;
+}
+
+const sched_task_t *
+sched_task(uint8_t id)
+{
+    sched_task_t *t = s_head;
+    while (t && id--)
+    { t = t->next; }
+    return t;
+}
+
+static bool
+sched_woken(const sched_task_t *t, uint8_t ev, uint32_t now)
+{
+    if (t->signal)
+    { ev |= SCHED_EV_SIGNAL; }
+    if (timer_reached(now, t->due))
+    { ev |= SCHED_EV_TIMER; }
+    return (t->wait & ev) != 0;
+}
+
+/* runs the first woken task in priority order, but not the one that
+   ran last while another task is woken: a task that stays ready (a
+   yield, a busy RX line) cannot keep lower ones out; false if none */
+static bool
+sched_scan(void)
+{
+    static sched_task_t *s_last = NULL;
+
+    uint32_t now = timer_now();
+    uint8_t  ev  = SCHED_EV_NOW;
+    if (uart_rx_pending())
+    { ev |= SCHED_EV_RX; }
+    if (eeprom_is_ready())
+    { ev |= SCHED_EV_EEPROM; }
+
+    sched_task_t *t    = s_head;
+    bool          last = false;
+    for (; t; t = t->next)
+    {
+        if (!sched_woken(t, ev, now))
+        { continue; }
+        if (t != s_last)
+        { break; }
+        last = true;
+    }
+    if (!t && last)
+    { t = s_last; }
+    if (!t)
+    { return false; }
+
+    /* cleared first, so a signal raised while it runs wakes it again */
+    t->signal = 0;
+    s_last    = t;
+
+    uint32_t t0 = timer_now_us();
+    loopstat_enter(t->id);
+    if (t->fn(t) >= PT_EXITED)
+    { t->wait = 0; }
+    loopstat_account(t->id, t0);
+    return true;
+}
+
+void
+sched_run(void)
+{
+    uint8_t id = 0;
+    for (sched_task_t *t = s_head; t; t = t->next)
+    { t->id = id++; }
+
+    for (;;)
+    {
+        bool ran = sched_scan();
+        loopstat_pass();
+#if SCHED_IDLE_SLEEP
+        if (!ran)
+        {
+            /* the instruction after sei always runs, so an RX byte that
+               lands after the check still wakes us; timer and EEPROM
+               wake-ups are caught by the 1 ms tick */
+            set_sleep_mode(SLEEP_MODE_IDLE);
+            cli();
+            if (!uart_rx_pending())
+            {
+                sleep_enable();
+                sei();
+                sleep_cpu();
+                sleep_disable();
+            }
+            sei();
+        }
+#else
+        (void)ran;
+#endif
+    }
+}
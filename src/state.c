@@ -0,0 +1,115 @@
+#include "state.h"
+#include "gpio.h"
+#include "led.h"
+#include "alarm.h"
+#include "config.h"
+
+#if FEAT_STATE
+
+/* a stamp never trails s_ver by more than this; a host further behind
+   (or ahead, from before a reboot) gets every field */
+#define STATE_VER_WINDOW 0x8000U
+
+static uint16_t s_ver = 0;
+static uint8_t  s_val[STATE_FIELD_COUNT];
+static uint16_t s_stamp[STATE_FIELD_COUNT];
+
+state_field_t
+state_field_kind(state_field_t f, uint8_t *ch)
+{
+    *ch = 0;
+    if (f < STATE_CH_BASE)
+    { return f; }
+
+    uint8_t i = (uint8_t)(f - STATE_CH_BASE);
+    *ch = (uint8_t)(1 + i / 3);
+    return (state_field_t)(STATE_LED + i % 3);
+}
+
+static uint8_t
+read_live(state_field_t f)
+{
+    uint8_t       ch;
+    state_field_t kind = state_field_kind(f, &ch);
+#if FEAT_LED
+    led_state_t   led  = effects_get(ch);
+#endif
+
+    /* fields of compiled-out features read as 0 */
+    switch (kind)
+    {
+        case STATE_LAMP:   return lamp_get();
+#if FEAT_LED
+        case STATE_LED:    return led.state;
+        case STATE_MODE:   return (uint8_t)led.mode;
+        case STATE_BRIGHT: return led.brightness;
+#endif
+#if FEAT_ALARM
+        case STATE_ALARM:  return (uint8_t)alarm_get_mode();
+#endif
+        default:           return 0;
+    }
+}
+
+void
+state_init(void)
+{
+    /* Version 0 means "never seen anything", so start every field at 1 */
+    s_ver = 1;
+    for (uint8_t i = 0; i < STATE_FIELD_COUNT; i++)
+    {
+        s_val[i]   = read_live((state_field_t)i);
+        s_stamp[i] = s_ver;
+    }
+}
+
+void
+state_sync(void)
+{
+    bool bumped = false;
+    for (uint8_t i = 0; i < STATE_FIELD_COUNT; i++)
+    {
+        uint8_t v = read_live((state_field_t)i);
+        if (v == s_val[i])
+        { continue; }
+
+        if (!bumped)
+        {
+            s_ver++;
+            if (s_ver == 0) { s_ver = 1; } /* keep 0 reserved */
+            bumped = true;
+        }
+        s_val[i]   = v;
+        s_stamp[i] = s_ver;
+    }
+
+    /* drag stale stamps along so serial arithmetic on them stays valid */
+    for (uint8_t i = 0; bumped && i < STATE_FIELD_COUNT; i++)
+    {
+        if ((uint16_t)(s_ver - s_stamp[i]) >= STATE_VER_WINDOW)
+        { s_stamp[i] = (uint16_t)(s_ver - (STATE_VER_WINDOW - 1)); }
+    }
+}
+
+uint16_t
+state_version(void)
+{
+    return s_ver;
+}
+
+uint8_t
+state_value(state_field_t f)
+{
+    return s_val[f];
+}
+
+bool
+state_changed_since(state_field_t f, uint16_t ver)
+{
+    uint16_t behind = (uint16_t)(s_ver - ver);
+    if (ver == 0 || behind >= STATE_VER_WINDOW)
+    { return true; }
+    return (uint16_t)(s_ver - s_stamp[f]) < behind;
+}
+
+#endif /* FEAT_STATE */
@@ -1,45 +1,81 @@
 #include "storage.h"
+#include "sched.h"
 #include <avr/eeprom.h>
+#include <avr/pgmspace.h>
 
 #define NV_MAGIC 0x31585856UL /* 'VX X1' arbitrary; keep 0x56 'V' low byte */
-#define NV_VER   1
+/* layout revision << 4 | LED channel count, so an image written by a
+   build with another channel count is never accepted */
+#define NV_VER   (0x20 | (FEAT_LED ? LED_CHANNELS : 0))
 
 static nv_state_t EEMEM ee_state;
 
+/* Pending commit, written back one byte per EEPROM cycle (~3.4 ms each)
+ * by the STORAGE task, so a save never stalls the scheduler. */
+static nv_state_t s_pending;
+static uint8_t    s_pending_idx = sizeof(nv_state_t);
+
+#if FEAT_PRESET
+#define PRESET_TAG 0xA5
+
+static preset_t EEMEM ee_preset[PRESET_COUNT];
+
+/* one preset write-back in flight, behind the live state */
+static preset_t   s_pre_pending;
+static uint8_t    s_pre_slot = 0;
+static uint8_t    s_pre_idx  = sizeof(preset_t);
+#endif
+
+SCHED_TASK(s_storage_task, storage_task, "STORAGE", SCHED_PRIO_STORAGE)
+
 static uint8_t
 calc_crc(const nv_state_t *st)
 {
     return crc8_dallas((const uint8_t *)st, (uint8_t)(sizeof(nv_state_t) - 1));
 }
 
+void
+storage_defaults(nv_state_t *out)
+{
+    out->magic     = NV_MAGIC;
+    out->version   = NV_VER;
+    out->lamp_on   = 0;
+#if FEAT_LED
+    for (uint8_t ch = 0; ch < LED_CHANNELS; ch++)
+    {
+        out->led[ch].mode  = LED_MODE_BLINK;
+        out->led[ch].state = 1;
+        out->led[ch].brightness = 64;
+        out->led[ch].actual_bright = 0;
+        out->led[ch].auto_bright = 0;
+    }
+#endif
+    out->crc8      = calc_crc(out);
+}
+
+void
+storage_seal(nv_state_t *st)
+{
+    st->magic   = NV_MAGIC;
+    st->version = NV_VER;
+    st->crc8    = calc_crc(st);
+}
+
+bool
+storage_check(const nv_state_t *st)
+{
+    return st->magic == NV_MAGIC && st->version == NV_VER
+        && calc_crc(st) == st->crc8;
+}
+
 void
 storage_load(nv_state_t *out)
 {
     nv_state_t tmp;
     eeprom_read_block(&tmp, &ee_state, sizeof(tmp));
-    if (tmp.magic != NV_MAGIC || tmp.version != NV_VER)
-    {
-        out->magic     = NV_MAGIC;
-        out->version   = NV_VER;
-        out->lamp_on   = 0;
-        out->led.mode  = LED_MODE_BLINK;
-        out->led.state = 1;
-        out->led.brightness = 64;
-        out->led.actual_bright = 0;
-        out->crc8      = calc_crc(out);
-        return;
-    }
-    uint8_t crc = calc_crc(&tmp);
-    if (crc != tmp.crc8)
+    if (!storage_check(&tmp))
     {
-        out->magic     = NV_MAGIC;
-        out->version   = NV_VER;
-        out->lamp_on   = 0;
-        out->led.mode  = LED_MODE_BLINK;
-        out->led.state = 1;
-        out->led.brightness = 64;
-        out->led.actual_bright = 0;
-        out->crc8      = calc_crc(out);
+        storage_defaults(out);
         return;
     }
     *out = tmp;
@@ -48,25 +84,131 @@ storage_load(nv_state_t *out)
 void
 storage_save(const nv_state_t *st)
 {
-    nv_state_t tmp = *st;
-    tmp.crc8 = calc_crc(&tmp);
-    eeprom_update_block(&tmp, &ee_state, sizeof(tmp));
+    /* a newer save simply restarts the write-back with the new image */
+    s_pending      = *st;
+    s_pending.crc8 = calc_crc(&s_pending);
+    s_pending_idx  = 0;
+    sched_signal(&s_storage_task);
+}
+
+static void
+write_back(const void *src, void *dst, uint8_t *idx, uint8_t len)
+{
+    const uint8_t *s = (const uint8_t *)src;
+    uint8_t       *d = (uint8_t *)dst;
+
+    /* unchanged bytes are skipped in the same pass, a real write ends it */
+    while (*idx < len && eeprom_is_ready())
+    {
+        eeprom_update_byte(d + *idx, s[*idx]);
+        (*idx)++;
+    }
+}
+
+void
+storage_poll(void)
+{
+    write_back(&s_pending, &ee_state, &s_pending_idx, sizeof(nv_state_t));
+#if FEAT_PRESET
+    if (s_pending_idx == sizeof(nv_state_t))
+    { write_back(&s_pre_pending, &ee_preset[s_pre_slot], &s_pre_idx, sizeof(preset_t)); }
+#endif
 }
 
+static bool
+storage_queued(void)
+{
+#if FEAT_PRESET
+    if (s_pre_idx < sizeof(preset_t))
+    { return true; }
+#endif
+    return s_pending_idx < sizeof(nv_state_t);
+}
+
+uint8_t
+storage_busy(void)
+{
+    return storage_queued() || !eeprom_is_ready();
+}
+
+/* one byte per run, the next once the EEPROM has finished it */
+static char
+storage_task(sched_task_t *t)
+{
+    PT_BEGIN(&t->pt);
+    for (;;)
+    {
+        storage_poll();
+        if (storage_queued())
+        { SCHED_WAIT(t, SCHED_EV_EEPROM); }
+        else
+        { SCHED_WAIT(t, SCHED_EV_SIGNAL); }
+    }
+    PT_END(&t->pt);
+}
+
+#if FEAT_PRESET
+static uint8_t
+preset_crc(const preset_t *p)
+{
+    return crc8_dallas((const uint8_t *)p, (uint8_t)(sizeof(preset_t) - 1));
+}
+
+bool
+storage_preset_get(uint8_t n, preset_t *out)
+{
+    if (n >= PRESET_COUNT)
+    { return false; }
+
+    /* a queued image is newer than what the EEPROM holds */
+    if (n == s_pre_slot && s_pre_idx < sizeof(preset_t))
+    { *out = s_pre_pending; return true; }
+
+    eeprom_read_block(out, &ee_preset[n], sizeof(*out));
+    return out->tag == PRESET_TAG && preset_crc(out) == out->crc8;
+}
+
+void
+storage_preset_put(uint8_t n, const preset_t *p)
+{
+    if (n >= PRESET_COUNT)
+    { return; }
+
+    /* another slot still queued: finish it now (blocks ~3.4 ms per
+       changed byte), only back-to-back saves of two presets get here */
+    if (s_pre_idx < sizeof(preset_t) && n != s_pre_slot)
+    {
+        eeprom_update_block((const uint8_t *)&s_pre_pending + s_pre_idx,
+                            (uint8_t *)&ee_preset[s_pre_slot] + s_pre_idx,
+                            sizeof(preset_t) - s_pre_idx);
+    }
+
+    s_pre_pending      = *p;
+    s_pre_pending.tag  = PRESET_TAG;
+    s_pre_pending.crc8 = preset_crc(&s_pre_pending);
+    s_pre_slot         = n;
+    s_pre_idx          = 0;
+    sched_signal(&s_storage_task);
+}
+#endif
+
+/* 0x8C (reflected 0x31) applied to each nibble value, two lookups per
+   byte instead of eight shift/xor steps */
+static const uint8_t s_crc_nib[16] PROGMEM =
+{
+    0x00, 0x9D, 0x23, 0xBE, 0x46, 0xDB, 0x65, 0xF8,
+    0x8C, 0x11, 0xAF, 0x32, 0xCA, 0x57, 0xE9, 0x74,
+};
+
 uint8_t
 crc8_dallas(const uint8_t *p, uint8_t len)
 {
     uint8_t crc = 0;
     for (uint8_t i = 0; i < len; i++)
     {
-        uint8_t inbyte = p[i];
-        for (uint8_t j = 0; j < 8; j++)
-        {
-            uint8_t mix = (crc ^ inbyte) & 0x01;
-            crc >>= 1;
-            if (mix) { crc ^= 0x8C; } /* poly 0x31 reflected -> 0x8C */
-            inbyte >>= 1;
-        }
+        crc ^= p[i];
+        crc = (uint8_t)((crc >> 4) ^ pgm_read_byte(&s_crc_nib[crc & 0x0F]));
+        crc = (uint8_t)((crc >> 4) ^ pgm_read_byte(&s_crc_nib[crc & 0x0F]));
     }
     return crc;
 }
@@ -0,0 +1,69 @@
+#include "trace.h"
+#include "timer.h"
+#include "config.h"
+
+#if FEAT_TRACE
+
+#define TRACE_MAGIC 0x7E3C
+
+typedef struct
+{
+    uint16_t      magic;
+    uint8_t       head;   /* next slot to write */
+    uint8_t       count;
+    trace_entry_t e[TRACE_DEPTH];
+} trace_ring_t;
+
+static trace_ring_t s_tr __attribute__((section(".noinit")));
+static bool         s_on = false;  /* ring checked: set by trace_init */
+
+void
+trace_init(void)
+{
+    if (s_tr.magic != TRACE_MAGIC || s_tr.head >= TRACE_DEPTH
+        || s_tr.count > TRACE_DEPTH)
+    {
+        s_tr.magic = TRACE_MAGIC;
+        s_tr.head  = 0;
+        s_tr.count = 0;
+    }
+    s_on = true;
+    trace_record(TRACE_EV_BOOT, 0, TRACE_RES_NONE, 0);
+}
+
+void
+trace_record(uint8_t verb, uint8_t noun, uint8_t result, uint16_t dur_us)
+{
+    if (!s_on)
+    { return; } /* commands before the BOOT task are not recorded */
+
+    trace_entry_t *e = &s_tr.e[s_tr.head];
+    e->t_ms   = timer_now();
+    e->verb   = verb;
+    e->noun   = noun;
+    e->result = result;
+    e->dur_us = dur_us;
+
+    if (++s_tr.head == TRACE_DEPTH) { s_tr.head = 0; }
+    if (s_tr.count < TRACE_DEPTH)   { s_tr.count++; }
+}
+
+uint8_t
+trace_count(void)
+{
+    return s_on ? s_tr.count : 0;
+}
+
+bool
+trace_get(uint8_t idx, trace_entry_t *out)
+{
+    if (idx >= s_tr.count)
+    { return false; }
+
+    uint8_t i = (uint8_t)(s_tr.head + TRACE_DEPTH - s_tr.count + idx);
+    if (i >= TRACE_DEPTH) { i -= TRACE_DEPTH; }
+    *out = s_tr.e[i];
+    return true;
+}
+
+#endif /* FEAT_TRACE */
@@ -1,8 +1,14 @@
 #include "uart.h"
+#include "config.h"
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <util/setbaud.h>
 
+#if RS485_ENABLE
+#include "timer.h"
+#endif
+
 #ifndef RX_BUF_SZ
 #define RX_BUF_SZ 256
 #endif
@@ -14,10 +20,50 @@ static volatile uint8_t rx_buf[RX_BUF_SZ];
 static volatile uint8_t rx_head = 0;
 static volatile uint8_t rx_tail = 0;
 
+static volatile uint16_t rx_ovf = 0;
+
+#if RX_ADDR_FILTER
+/* ISR-level TO-field matcher.  While in RXF_MATCH the address bytes are
+ * held back and compared against each candidate; on ':' the matched
+ * address is pushed and the rest of the line passes through, otherwise
+ * the line is discarded up to '\n' without touching the ring buffer. */
+enum { RXF_MATCH = 0, RXF_PASS, RXF_DROP };
+
+#define RXF_SELF  0x01
+#define RXF_ALL   0x02
+
+static const char s_addr_self[] PROGMEM = NODE_ADDR;
+static const char s_addr_all[]  PROGMEM = "ALL";
+
+static uint8_t           rxf_state = RXF_MATCH;
+static uint8_t           rxf_idx   = 0;
+static uint8_t           rxf_cand  = RXF_SELF | RXF_ALL;
+static volatile uint16_t rxf_dropped = 0;
+#endif
+
 static volatile uint8_t tx_buf[TX_BUF_SZ];
 static volatile uint8_t tx_head = 0;
 static volatile uint8_t tx_tail = 0;
 
+#if RS485_ENABLE
+static volatile uint8_t  rs_tx_active  = 0; /* DE asserted, we own the bus */
+static volatile uint32_t rs_rx_last    = 0; /* time of last byte on the bus */
+
+/* Deferred frames wait in the ring: each hold marks where one starts and
+ * when it may go.  The oldest is published to the ISRs as rs_stop_at,
+ * where transmission stops (DE dropped) even in the middle of a burst. */
+typedef struct
+{
+    uint8_t  at;
+    uint32_t not_before;
+} rs_hold_t;
+
+static rs_hold_t         rs_hold[RS485_HOLDS];
+static uint8_t           rs_holds      = 0;
+static volatile uint8_t  rs_stop       = 0;
+static volatile uint8_t  rs_stop_at    = 0;
+#endif
+
 void
 uart_init(uint32_t baud)
 {
@@ -31,33 +77,193 @@ uart_init(uint32_t baud)
     UCSR0A &= (uint8_t)~_BV(U2X0);
 #endif
     UCSR0C = _BV(UCSZ01) | _BV(UCSZ00); /* 8N1 */
+#if RS485_ENABLE
+    RS485_DE_PORT &= (uint8_t)~RS485_DE_BM; /* listen */
+    RS485_DE_DDR  |= RS485_DE_BM;
+    UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0) | _BV(TXCIE0);
+#else
     UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0) | _BV(UDRIE0);
+#endif
+}
+
+#if RS485_ENABLE
+/* nothing (more) may go out right now: ring empty or a held frame next */
+static inline uint8_t
+rs_blocked(void)
+{
+    return tx_head == tx_tail || (rs_stop && tx_tail == rs_stop_at);
+}
+
+ISR(USART_TX_vect)
+{
+    /* last stop bit is out; hand the bus back unless more may follow */
+    if (rs_blocked())
+    {
+        RS485_DE_PORT &= (uint8_t)~RS485_DE_BM;
+        rs_tx_active = 0;
+    }
+}
+
+static void
+rs485_gate(void)
+{
+    uint32_t now  = timer_now();
+    uint8_t  sreg = SREG;
+    cli();
+    /* release the holds that are due, in ring order */
+    while (rs_holds && timer_reached(now, rs_hold[0].not_before))
+    {
+        rs_holds--;
+        for (uint8_t i = 0; i < rs_holds; i++)
+        { rs_hold[i] = rs_hold[i + 1]; }
+    }
+    rs_stop    = rs_holds != 0;
+    rs_stop_at = rs_hold[0].at;
+
+    if (!rs_blocked())
+    {
+        if (rs_tx_active)
+        { UCSR0B |= _BV(UDRIE0); } /* released under our own DE: carry on */
+        else if ((now - rs_rx_last) >= RS485_IDLE_MS)
+        {
+            RS485_DE_PORT |= RS485_DE_BM;
+            rs_tx_active   = 1;
+            UCSR0B |= _BV(UDRIE0);
+        }
+    }
+    SREG = sreg;
+}
+#endif
+
+static inline void
+tx_kick(void)
+{
+#if RS485_ENABLE
+    if (!rs_tx_active)
+    { return; } /* rs485_gate() starts it */
+#endif
+    UCSR0B |= _BV(UDRIE0);
 }
 
 ISR(USART_UDRE_vect)
 {
+#if RS485_ENABLE
+    if (rs_blocked())
+#else
     if (tx_head == tx_tail)
+#endif
     {
-        UCSR0B &= (uint8_t)~_BV(UDRIE0); /* nothing to send */
+        UCSR0B &= (uint8_t)~_BV(UDRIE0); /* nothing to send (yet) */
         return;
     }
     UDR0 = tx_buf[tx_tail];
     tx_tail = (uint8_t)((tx_tail + 1) % TX_BUF_SZ);
 }
 
-ISR(USART_RX_vect)
+static inline void
+rx_push(uint8_t data)
 {
-    uint8_t data = UDR0;
     uint8_t next = (uint8_t)((rx_head + 1) % RX_BUF_SZ);
     if (next == rx_tail)
     {
         /* overflow, drop oldest */
         rx_tail = (uint8_t)((rx_tail + 1) % RX_BUF_SZ);
+        rx_ovf++;
     }
     rx_buf[rx_head] = data;
     rx_head         = next;
 }
 
+#if RX_ADDR_FILTER
+static inline void
+rxf_reset(void)
+{
+    rxf_state = RXF_MATCH;
+    rxf_idx   = 0;
+    rxf_cand  = RXF_SELF | RXF_ALL;
+}
+
+static inline uint8_t
+rxf_cand_at(uint8_t idx, uint8_t c)
+{
+    uint8_t cand = 0;
+    if ((rxf_cand & RXF_SELF) && pgm_read_byte(&s_addr_self[idx]) == c)
+    { cand |= RXF_SELF; }
+    if ((rxf_cand & RXF_ALL) && pgm_read_byte(&s_addr_all[idx]) == c)
+    { cand |= RXF_ALL; }
+    return cand;
+}
+
+/* Returns 1 if `c` itself still has to be pushed */
+static inline uint8_t
+rx_filter(uint8_t c)
+{
+    if (rxf_state != RXF_MATCH)
+    {
+        uint8_t pass = (rxf_state == RXF_PASS);
+        if (c == '\n') { rxf_reset(); }
+        return pass;
+    }
+
+    if (c == ':' || c == '\n')
+    {
+        /* full match: the candidate string ends exactly here */
+        uint8_t hit = rxf_cand_at(rxf_idx, '\0');
+        if (!hit && c == ':')
+        {
+            rxf_state = RXF_DROP;
+            rxf_dropped++;
+            return 0;
+        }
+
+        /* on '\n' a partial prefix is passed on so the parser can reject it */
+        const char *addr = ((hit ? hit : rxf_cand) & RXF_SELF) ? s_addr_self : s_addr_all;
+        for (uint8_t i = 0; i < rxf_idx; i++)
+        { rx_push(pgm_read_byte(&addr[i])); }
+
+        if (c == '\n') { rxf_reset(); }
+        else            { rxf_state = RXF_PASS; }
+        return 1;
+    }
+
+    if (c == ' ' || c == '\r')
+    {
+        /* only trailing blanks, as the parser trims: the address must be
+           complete here, and its '\0' then fails any later non-blank */
+        rxf_cand = rxf_cand_at(rxf_idx, '\0');
+        if (!rxf_cand)
+        {
+            rxf_state = RXF_DROP;
+            rxf_dropped++;
+        }
+        return 0;
+    }
+
+    rxf_cand = c ? rxf_cand_at(rxf_idx, c) : 0;
+    rxf_idx++;
+    if (!rxf_cand)
+    {
+        rxf_state = RXF_DROP;
+        rxf_dropped++;
+    }
+    return 0;
+}
+#endif /* RX_ADDR_FILTER */
+
+ISR(USART_RX_vect)
+{
+    uint8_t data = UDR0;
+#if RS485_ENABLE
+    if (!rs_tx_active)
+    { rs_rx_last = timer_now(); }
+#endif
+#if RX_ADDR_FILTER
+    if (!rx_filter(data))
+    { return; }
+#endif
+    rx_push(data);
+}
+
 size_t
 uart_write(const uint8_t *data, size_t len)
 {
@@ -74,12 +280,14 @@ uart_write(const uint8_t *data, size_t len)
             {
                 tx_buf[tx_head] = data[i];
                 tx_head         = next;
-                UCSR0B |= _BV(UDRIE0);
+                tx_kick();
                 SREG = sreg;
                 written++;
                 break;
             }
             SREG = sreg;
+            uart_poll(); /* ring full: waits at line rate; dispatch and
+                            rejects check uart_tx_ready() first */
         } while (1);
     }
     return written;
@@ -97,6 +305,19 @@ uart_write_str(const char *s)
     return n;
 }
 
+size_t
+uart_write_str_P(const char *s)
+{
+    size_t n = 0;
+    uint8_t c;
+    while ((c = pgm_read_byte(s)) != 0)
+    {
+        n += uart_write(&c, 1);
+        s++;
+    }
+    return n;
+}
+
 int
 uart_read_byte(uint8_t *out)
 {
@@ -113,12 +334,96 @@ uart_read_byte(uint8_t *out)
     return 1;
 }
 
+int
+uart_rx_pending(void)
+{
+    /* single-byte indices, no need to hold interrupts off */
+    return rx_head != rx_tail;
+}
+
 int
 uart_tx_idle(void)
 {
     uint8_t sreg = SREG;
     cli();
     int idle = (tx_head == tx_tail);
+#if RS485_ENABLE
+    idle = idle && !rs_tx_active;
+#endif
     SREG = sreg;
     return idle;
 }
+
+void
+uart_poll(void)
+{
+#if RS485_ENABLE
+    rs485_gate();
+#endif
+}
+
+bool
+uart_tx_defer(uint16_t ms)
+{
+#if RS485_ENABLE
+    if (!ms)
+    { return true; }
+    if (rs_holds == RS485_HOLDS)
+    { return false; }
+
+    uint8_t sreg = SREG;
+    cli();
+    rs_hold[rs_holds].at         = tx_head;
+    rs_hold[rs_holds].not_before = timer_now() + ms;
+    rs_holds++;
+    rs_stop    = 1;
+    rs_stop_at = rs_hold[0].at;
+    SREG = sreg;
+#else
+    (void)ms;
+#endif
+    return true;
+}
+
+bool
+uart_tx_ready(uint16_t len)
+{
+    if (len > TX_BUF_SZ - 1U)
+    { len = TX_BUF_SZ - 1U; } /* a small ring (RELAY): wait until it drained */
+
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t used = (uint8_t)((tx_head - tx_tail + TX_BUF_SZ) % TX_BUF_SZ);
+    SREG = sreg;
+#if RS485_ENABLE
+    if (rs_holds >= RS485_HOLDS)
+    { return false; }
+#endif
+    return TX_BUF_SZ - 1U - used >= len;
+}
+
+static uint16_t
+read_u16_atomic(const volatile uint16_t *v)
+{
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t r = *v;
+    SREG = sreg;
+    return r;
+}
+
+uint16_t
+uart_rx_filtered(void)
+{
+#if RX_ADDR_FILTER
+    return read_u16_atomic(&rxf_dropped);
+#else
+    return 0;
+#endif
+}
+
+uint16_t
+uart_rx_overflows(void)
+{
+    return read_u16_atomic(&rx_ovf);
+}
@@ -1,9 +1,15 @@
 #include "util.h"
+#include "config.h"
 
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
 
+/* Not cleared by crt0: holds power-up SRAM noise on a cold boot and the
+   previous run's state after a warm reset. */
+static uint32_t s_prng __attribute__((section(".noinit")));
+
+#if FEAT_HEAP
 static char *
 dup_range(const char *start, const char *end_excl)
 {
@@ -48,3 +54,80 @@ parse_packet_alloc(const char *packet, char **to, char **payload, char **from)
     *from    = from_s;
     return true;
 }
+#endif
+
+/* Same split as parse_packet_alloc, but the separators are overwritten
+   with NULs and the fields point into packet. */
+bool
+parse_packet_inplace(char *packet, char **to, char **payload, char **from)
+{
+    if (!packet || !to || !payload || !from) { return false; }
+
+    char *first = strchr(packet, ':');
+    char *last  = strrchr(packet, ':');
+
+    if (!first || !last || first == last) { return false; }
+    if (first == packet) { return false; }
+    if (*(last + 1) == '\0') { return false; }
+
+    *first = '\0';
+    *last  = '\0';
+    *to      = packet;
+    *payload = first + 1;
+    *from    = last + 1;
+    return true;
+}
+
+static int8_t
+hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9') { return (int8_t)(c - '0'); }
+    if (c >= 'A' && c <= 'F') { return (int8_t)(c - 'A' + 10); }
+    if (c >= 'a' && c <= 'f') { return (int8_t)(c - 'a' + 10); }
+    return -1;
+}
+
+void
+hex_encode(const uint8_t *in, uint8_t len, char *out)
+{
+    for (uint8_t i = 0; i < len; i++)
+    {
+        uint8_t hi = in[i] >> 4, lo = in[i] & 0x0F;
+        *out++ = (char)(hi < 10 ? '0' + hi : 'A' + hi - 10);
+        *out++ = (char)(lo < 10 ? '0' + lo : 'A' + lo - 10);
+    }
+    *out = '\0';
+}
+
+bool
+hex_decode(const char *in, uint8_t *out, uint8_t len)
+{
+    if (strlen(in) != (size_t)len * 2) { return false; }
+
+    for (uint8_t i = 0; i < len; i++)
+    {
+        int8_t hi = hex_nibble(in[2 * i]);
+        int8_t lo = hex_nibble(in[2 * i + 1]);
+        if (hi < 0 || lo < 0) { return false; }
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+void
+prng_seed(uint32_t mix)
+{
+    s_prng ^= mix;
+    if (!s_prng) { s_prng = 0x2545F491UL; } /* xorshift must not be 0 */
+}
+
+uint16_t
+prng_next(void)
+{
+    uint32_t x = s_prng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_prng = x;
+    return (uint16_t)(x >> 16);
+}
@@ -0,0 +1,146 @@
+#include "ws2812.h"
+#include "config.h"
+#include "timer.h"
+
+#if WS2812_ENABLE
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <string.h>
+
+#if F_CPU != 16000000UL
+#error "ws2812 bit timing is written for 16 MHz"
+#endif
+
+#if WS2812_PIXELS < 1 || WS2812_PIXELS > 128
+#error "WS2812_PIXELS must be 1..128 (3 bytes of SRAM each)"
+#endif
+
+/* > 50 us (WS2812) / 280 us (WS2812B v5) low latches a frame */
+#define WS2812_LATCH_US 300UL
+
+static uint8_t  s_fb[WS2812_PIXELS * 3];   /* G, R, B per pixel */
+static bool     s_dirty    = false;
+static uint16_t s_frames   = 0;
+static uint16_t s_frame_us = 0;
+static uint32_t s_last_us  = 0;
+
+/* 20 cycles (1.25 us) per bit: high for 6 cycles (375 ns) on a 0 and
+   13 cycles (812 ns) on a 1.  Between bytes the low phase is 6 cycles
+   longer, well inside the chips' tolerance.  Caller holds interrupts. */
+static void
+ws2812_tx(const uint8_t *p, uint16_t n)
+{
+#if defined(__AVR__)
+    uint8_t hi = WS2812_PORT | WS2812_PIN_BM;
+    uint8_t lo = WS2812_PORT & (uint8_t)~WS2812_PIN_BM;
+    uint8_t byte, bit;
+
+    __asm__ volatile (
+        "0:  ld   %[byte], %a[p]+ \n\t"
+        "    ldi  %[bit], 8       \n\t"
+        "1:  out  %[port], %[hi]  \n\t"   /* t=0   rise                 */
+        "    lsl  %[byte]         \n\t"   /* t=1   C = this bit         */
+        "    nop                  \n\t"
+        "    nop                  \n\t"
+        "    nop                  \n\t"
+        "    brcs 2f              \n\t"   /* t=5                        */
+        "    out  %[port], %[lo]  \n\t"   /* t=6   fall for a 0         */
+        "2:  nop                  \n\t"   /* t=7   both paths join      */
+        "    nop                  \n\t"
+        "    nop                  \n\t"
+        "    nop                  \n\t"
+        "    nop                  \n\t"
+        "    nop                  \n\t"
+        "    out  %[port], %[lo]  \n\t"   /* t=13  fall for a 1         */
+        "    nop                  \n\t"
+        "    nop                  \n\t"
+        "    nop                  \n\t"
+        "    dec  %[bit]          \n\t"   /* t=17                       */
+        "    brne 1b              \n\t"   /* t=18, next rise at t=20    */
+        "    sbiw %[n], 1         \n\t"
+        "    brne 0b              \n\t"
+        : [p] "+e" (p), [n] "+w" (n), [byte] "=&r" (byte), [bit] "=&d" (bit)
+        : [port] "I" (_SFR_IO_ADDR(WS2812_PORT)), [hi] "r" (hi), [lo] "r" (lo)
+        : "memory");
+#else
+    (void)p; (void)n; /* host simulator: no strip attached */
+#endif
+}
+
+void
+ws2812_init(void)
+{
+    WS2812_PORT &= (uint8_t)~WS2812_PIN_BM;
+    WS2812_DDR  |= WS2812_PIN_BM;
+    memset(s_fb, 0, sizeof(s_fb));
+    s_dirty = true;
+}
+
+void
+ws2812_set(uint16_t i, uint8_t r, uint8_t g, uint8_t b)
+{
+    if (i >= WS2812_PIXELS)
+    { return; }
+
+    uint8_t *px = &s_fb[i * 3];
+    if (px[0] == g && px[1] == r && px[2] == b)
+    { return; }
+
+    px[0] = g; px[1] = r; px[2] = b;
+    s_dirty = true;
+}
+
+void
+ws2812_fill(uint8_t r, uint8_t g, uint8_t b)
+{
+    for (uint16_t i = 0; i < WS2812_PIXELS; i++)
+    { ws2812_set(i, r, g, b); }
+}
+
+bool
+ws2812_show(void)
+{
+    if (!s_dirty)
+    { return false; }
+
+    uint32_t t0 = timer_now_us();
+    if (s_frames && (t0 - s_last_us) < WS2812_LATCH_US)
+    { return false; } /* previous frame not latched yet, stays dirty */
+
+    s_dirty = false;
+
+    const uint8_t *p    = s_fb;
+    uint16_t       left = WS2812_PIXELS;
+    while (left)
+    {
+        uint16_t k = (WS2812_CHUNK && left > WS2812_CHUNK) ? WS2812_CHUNK : left;
+
+        uint8_t sreg = SREG;
+        cli();
+        ws2812_tx(p, (uint16_t)(k * 3));
+        SREG = sreg; /* WS2812_CHUNK: the line idles low while pending ISRs run */
+
+        p    += k * 3;
+        left -= k;
+    }
+
+    s_last_us  = timer_now_us();
+    s_frame_us = (uint16_t)(s_last_us - t0);
+    s_frames++;
+    return true;
+}
+
+uint16_t
+ws2812_frames(void)
+{
+    return s_frames;
+}
+
+uint16_t
+ws2812_frame_us(void)
+{
+    return s_frame_us;
+}
+
+#endif /* WS2812_ENABLE */